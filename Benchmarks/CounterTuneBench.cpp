@@ -0,0 +1,300 @@
+// Microbenchmarks for the hot kernels on the pitch and melody paths, built with
+// -DCOUNTERTUNE_BUILD_BENCHMARKS=ON and run headless:
+//
+//   CounterTuneBench [--iterations=N] [--filter=text] [--output=results.json]
+//
+// Every benchmark runs a few untimed iterations first and then times each iteration on its own,
+// so the JSON has the spread as well as the mean. Benchmarks that need a model that isn't in
+// BinaryData are listed as skipped rather than left out.
+
+#include <JuceHeader.h>
+#include <iostream>
+#include <numeric>
+#include "PitchDetector.h"
+#include "MelodyGenerator.h"
+
+#ifndef COUNTERTUNE_GIT_COMMIT
+ #define COUNTERTUNE_GIT_COMMIT ""
+#endif
+
+// The kernels are private, the classes grant this struct access to them
+struct BenchmarkAccess {
+    static void pinFullQuality(PitchDetector& detector) {
+        // keeps a slow machine from timing the DSP fallback instead of CREPE
+        detector.qualityController.setTierAvailable(QualityController::Tier::reducedRate, false);
+        detector.qualityController.setTierAvailable(QualityController::Tier::tinyModel, false);
+        detector.qualityController.setTierAvailable(QualityController::Tier::dspEstimator, false);
+    }
+
+    static void decodeOutput(const PitchDetector& detector, const float* output, int numBins, float& frequency, float& confidence) {
+        detector.decodeOutput(output, numBins, frequency, confidence);
+    }
+
+    static float mapIndexToFrequency(const PitchDetector& detector, int index) {
+        return detector.mapIndexToFrequency(index);
+    }
+
+    static bool runDspEstimator(const PitchDetector& detector, const float* frame, float& frequency, float& confidence) {
+        return detector.runDspEstimator(frame, frequency, confidence);
+    }
+
+    static void eventsToOnehot(MelodyGenerator& generator, const std::vector<int>& events, float* row) {
+        generator.eventsToOnehot(events.data(), static_cast<int>(events.size()), row);
+    }
+
+    static void createBatchInput(MelodyGenerator& generator, const std::vector<int>& events, std::vector<float>& batch) {
+        generator.createBatchInput(events, batch);
+    }
+
+    static std::vector<int> sampleEvents(MelodyGenerator& generator, const float* outputProbs, int steps, float temperature) {
+        return generator.sampleEvents(outputProbs, steps, temperature);
+    }
+};
+
+namespace {
+
+    constexpr double benchSampleRate = 48000.0;
+    constexpr int crepeFrameSize = 1024;
+    constexpr int crepeBins = 360;
+    constexpr int seqLength = 32;
+    constexpr int numClasses = 130;
+
+    // Keeps results alive so the optimiser can't drop the work that produced them
+    volatile float sink = 0.0f;
+
+    class BenchmarkRunner {
+    public:
+        BenchmarkRunner(int iterationsToRun, const juce::String& nameFilter)
+            : iterations(juce::jmax(1, iterationsToRun)), filter(nameFilter) {}
+
+        // itemsPerIteration is what one call processes (frames, phrases...), for the throughput column
+        template <typename Function>
+        void run(const juce::String& name, double itemsPerIteration, Function&& function) {
+            if (!shouldRun(name)) return;
+
+            const int warmUpIterations = juce::jmax(1, iterations / 10);
+            for (int i = 0; i < warmUpIterations; ++i)
+                function();
+
+            std::vector<double> micros(static_cast<size_t>(iterations));
+            for (auto& sample : micros) {
+                const auto start = juce::Time::getHighResolutionTicks();
+                function();
+                sample = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1.0e6;
+            }
+
+            std::sort(micros.begin(), micros.end());
+            const double mean = std::accumulate(micros.begin(), micros.end(), 0.0) / micros.size();
+            const auto percentile = [&](double p) { return micros[static_cast<size_t>(p * (micros.size() - 1))]; };
+
+            auto* result = new juce::DynamicObject();
+            result->setProperty("name", name);
+            result->setProperty("iterations", iterations);
+            result->setProperty("meanUs", mean);
+            result->setProperty("medianUs", percentile(0.5));
+            result->setProperty("p99Us", percentile(0.99));
+            result->setProperty("minUs", micros.front());
+            result->setProperty("maxUs", micros.back());
+            result->setProperty("itemsPerSecond", mean > 0.0 ? itemsPerIteration * 1.0e6 / mean : 0.0);
+            results.add(juce::var(result));
+
+            std::cout << name.paddedRight(' ', 44) << juce::String(mean, 2).paddedLeft(' ', 12) << " us"
+                      << "   p99 " << juce::String(percentile(0.99), 2) << " us" << std::endl;
+        }
+
+        void skip(const juce::String& name, const juce::String& reason) {
+            if (!shouldRun(name)) return;
+
+            auto* result = new juce::DynamicObject();
+            result->setProperty("name", name);
+            result->setProperty("skipped", reason);
+            results.add(juce::var(result));
+
+            std::cout << name.paddedRight(' ', 44) << "skipped: " << reason << std::endl;
+        }
+
+        juce::var toJson() const {
+            auto* root = new juce::DynamicObject();
+            root->setProperty("commit", juce::String(COUNTERTUNE_GIT_COMMIT));
+            root->setProperty("timestamp", juce::Time::getCurrentTime().toISO8601(true));
+            root->setProperty("cpu", juce::SystemStats::getCpuModel());
+            root->setProperty("cores", juce::SystemStats::getNumPhysicalCpus());
+           #if JUCE_DEBUG
+            root->setProperty("build", "debug");
+           #else
+            root->setProperty("build", "release");
+           #endif
+            root->setProperty("benchmarks", results);
+            return juce::var(root);
+        }
+
+    private:
+        int iterations;
+        juce::String filter;
+        juce::Array<juce::var> results;
+
+        bool shouldRun(const juce::String& name) const { return filter.isEmpty() || name.contains(filter); }
+    };
+
+    std::vector<float> makeSine(int numSamples, float frequency) {
+        std::vector<float> samples(static_cast<size_t>(numSamples));
+        for (int i = 0; i < numSamples; ++i)
+            samples[static_cast<size_t>(i)] = 0.5f * std::sin(juce::MathConstants<float>::twoPi * frequency * i / static_cast<float>(benchSampleRate));
+        return samples;
+    }
+
+    // Something shaped like a model output: one peak per row over a low floor
+    std::vector<float> makeDistribution(int rows, int columns, juce::Random& random) {
+        std::vector<float> values(static_cast<size_t>(rows * columns));
+        for (int r = 0; r < rows; ++r) {
+            float* row = values.data() + r * columns;
+            for (int c = 0; c < columns; ++c)
+                row[c] = 0.01f * random.nextFloat();
+            row[random.nextInt(columns)] = 0.9f;
+        }
+        return values;
+    }
+
+    std::vector<int> makePhrase(juce::Random& random) {
+        std::vector<int> events(seqLength, -2);
+        for (int i = 0; i < seqLength; i += 2)
+            events[static_cast<size_t>(i)] = random.nextInt(4) == 0 ? -1 : 60 + random.nextInt(12);
+        return events;
+    }
+
+    void benchmarkPitch(BenchmarkRunner& runner) {
+        PitchDetector detector;
+        detector.prepare(benchSampleRate);
+
+        float frequency = 0.0f, confidence = 0.0f;
+        auto sine = makeSine(crepeFrameSize * 8, 220.0f);
+        float* sineChannel = sine.data();
+
+        // model-free kernels first, they work without BinaryData
+        juce::Random random(1);
+        const auto output = makeDistribution(1, crepeBins, random);
+
+        runner.run("pitch.decodeOutput", 1.0, [&] {
+            BenchmarkAccess::decodeOutput(detector, output.data(), crepeBins, frequency, confidence);
+            sink = frequency;
+        });
+
+        runner.run("pitch.mapIndexToFrequency", crepeBins, [&] {
+            float sum = 0.0f;
+            for (int i = 0; i < crepeBins; ++i)
+                sum += BenchmarkAccess::mapIndexToFrequency(detector, i);
+            sink = sum;
+        });
+
+        runner.run("pitch.dspEstimator.frame", 1.0, [&] {
+            BenchmarkAccess::runDspEstimator(detector, sine.data(), frequency, confidence);
+            sink = frequency;
+        });
+
+        const juce::String modelBenchmarks[] = { "pitch.processBuffer.frame", "pitch.processBuffer.block64",
+                                                 "pitch.processBuffer.block256", "pitch.processBuffer.block4096",
+                                                 "pitch.processBuffer.frame.allStreams" };
+
+        if (!detector.initialize(BinaryData::crepe_small_onnx, BinaryData::crepe_small_onnxSize)) {
+            for (const auto& name : modelBenchmarks)
+                runner.skip(name, "CREPE model didn't load");
+            return;
+        }
+
+        BenchmarkAccess::pinFullQuality(detector);
+        detector.warmUp();
+
+        // One CREPE frame per call, hop and frame are both 1024 at full quality
+        const juce::AudioBuffer<float> frame(&sineChannel, 1, crepeFrameSize);
+        runner.run(modelBenchmarks[0], 1.0, [&] { detector.processBuffer(frame); });
+
+        // Host-sized blocks, most calls only accumulate and every so often one runs a frame
+        for (const int blockSize : { 64, 256, 4096 }) {
+            const juce::AudioBuffer<float> block(&sineChannel, 1, blockSize);
+            runner.run("pitch.processBuffer.block" + juce::String(blockSize), static_cast<double>(blockSize) / crepeFrameSize,
+                       [&] { detector.processBuffer(block); });
+        }
+
+        // Main input plus every sidechain. Without adaptation all of them run every hop, the main
+        // stream on its own and the sidechains batched when the model takes a batch
+        detector.setAdaptiveQuality(false);
+        std::array<float*, PitchDetector::maxStreams> streamChannels;
+        streamChannels.fill(sineChannel);
+        const juce::AudioBuffer<float> streams(streamChannels.data(), PitchDetector::maxStreams, crepeFrameSize);
+        runner.run(modelBenchmarks[4], PitchDetector::maxStreams, [&] { detector.processBuffer(streams); });
+    }
+
+    void benchmarkMelody(BenchmarkRunner& runner) {
+        MelodyGenerator generator;
+        juce::Random random(2);
+
+        const auto phrase = makePhrase(random);
+        const auto probabilities = makeDistribution(seqLength, numClasses, random);
+        std::vector<float> onehot(static_cast<size_t>(seqLength * numClasses));
+        std::vector<float> batch;
+
+        runner.run("melody.eventsToOnehot", 1.0, [&] {
+            BenchmarkAccess::eventsToOnehot(generator, phrase, onehot.data());
+            sink = onehot[2];
+        });
+
+        runner.run("melody.createBatchInput", 1.0, [&] {
+            BenchmarkAccess::createBatchInput(generator, phrase, batch);
+            sink = batch[0];
+        });
+
+        runner.run("melody.sampleEvents.t0.8", seqLength, [&] {
+            sink = static_cast<float>(BenchmarkAccess::sampleEvents(generator, probabilities.data(), seqLength, 0.8f)[0]);
+        });
+
+        runner.run("melody.sampleEvents.t1.0", seqLength, [&] {
+            sink = static_cast<float>(BenchmarkAccess::sampleEvents(generator, probabilities.data(), seqLength, 1.0f)[0]);
+        });
+
+        if (!generator.initialize(BinaryData::melody_model_onnx, BinaryData::melody_model_onnxSize)) {
+            runner.skip("melody.generateMelody", "melody model didn't load: " + juce::String(generator.getLastError()));
+            return;
+        }
+
+        generator.warmUp();
+
+        runner.run("melody.generateMelody", 1.0, [&] {
+            auto events = phrase;
+            sink = static_cast<float>(generator.generateMelody(events).size());
+        });
+
+        // eight phrases of line, all 15 windows fit in a single batched run
+        runner.run("melody.generateMelody.256steps", 8.0, [&] {
+            std::vector<int> events;
+            for (int i = 0; i < 8; ++i)
+                events.insert(events.end(), phrase.begin(), phrase.end());
+            sink = static_cast<float>(generator.generateMelody(events, 0.8f, 256).size());
+        });
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const juce::ArgumentList args(argc, argv);
+
+    const int iterations = args.containsOption("--iterations") ? args.getValueForOption("--iterations").getIntValue() : 200;
+    BenchmarkRunner runner(iterations, args.getValueForOption("--filter"));
+
+    benchmarkPitch(runner);
+    benchmarkMelody(runner);
+
+    const auto json = juce::JSON::toString(runner.toJson());
+
+    if (args.containsOption("--output")) {
+        const juce::File outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+        if (!outputFile.replaceWithText(json)) {
+            std::cerr << "Couldn't write " << outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+        std::cout << "Results written to " << outputFile.getFullPathName() << std::endl;
+    }
+    else {
+        std::cout << json << std::endl;
+    }
+
+    return 0;
+}
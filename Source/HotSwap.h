@@ -0,0 +1,21 @@
+#pragma once
+#include <functional>
+#include <memory>
+
+// Completion of a hot swap job. The job holds it through a shared_ptr, so a job the loader pool
+// drops without running it (the owner shutting down) still reports failure when it's destroyed.
+class HotSwapCompletion {
+public:
+    explicit HotSwapCompletion(std::function<void(bool)> callback) : onComplete(std::move(callback)) {}
+    ~HotSwapCompletion() { complete(false); }
+
+    void complete(bool swapped) {
+        auto callback = std::move(onComplete);
+        onComplete = nullptr;
+        if (callback)
+            callback(swapped);
+    }
+
+private:
+    std::function<void(bool)> onComplete;
+};
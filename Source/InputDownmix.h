@@ -0,0 +1,66 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+
+// Folds the input bus into the one channel the pitch path analyses, so only a mono stream crosses
+// over to the pitch thread. Mid is the default, a source panned hard to one side still gets
+// picked up. The mode can change from any thread, the audio thread sees it on its next block.
+class InputDownmix {
+public:
+    enum class Mode { left = 0, right, mid, channel };
+
+    void setMode(Mode newMode, int channelIndex = 0) noexcept {
+        selectedChannel.store(juce::jmax(0, channelIndex), std::memory_order_relaxed);
+        mode.store(static_cast<int>(newMode), std::memory_order_relaxed);
+    }
+
+    Mode getMode() const noexcept { return static_cast<Mode>(mode.load(std::memory_order_relaxed)); }
+    int getSelectedChannel() const noexcept { return selectedChannel.load(std::memory_order_relaxed); }
+
+    // Writes numSamples of the mix of the bus at channels [firstChannel, firstChannel + numBusChannels)
+    // of buffer, read from startSample on, to dest. A bus without channels mixes to silence.
+    void process(const juce::AudioBuffer<float>& buffer, int firstChannel, int numBusChannels, int startSample, int numSamples, float* dest) const noexcept {
+        const int numChannels = juce::jmin(numBusChannels, buffer.getNumChannels() - firstChannel);
+        if (numChannels < 1) {
+            juce::FloatVectorOperations::clear(dest, numSamples);
+            return;
+        }
+
+        const auto read = [&](int ch) { return buffer.getReadPointer(firstChannel + juce::jmin(ch, numChannels - 1), startSample); };
+
+        switch (getMode()) {
+            case Mode::left:
+                juce::FloatVectorOperations::copy(dest, read(0), numSamples);
+                break;
+            case Mode::right:
+                juce::FloatVectorOperations::copy(dest, read(1), numSamples);
+                break;
+            case Mode::channel:
+                juce::FloatVectorOperations::copy(dest, read(getSelectedChannel()), numSamples);
+                break;
+            case Mode::mid:
+                if (numChannels == 1) {
+                    juce::FloatVectorOperations::copy(dest, read(0), numSamples);
+                }
+                else {
+                    juce::FloatVectorOperations::copyWithMultiply(dest, read(0), 0.5f, numSamples);
+                    juce::FloatVectorOperations::addWithMultiply(dest, read(1), 0.5f, numSamples);
+                }
+                break;
+        }
+    }
+
+    static const char* getModeName(Mode m) {
+        switch (m) {
+            case Mode::left: return "left";
+            case Mode::right: return "right";
+            case Mode::mid: return "mid";
+            case Mode::channel: return "channel";
+        }
+        return "";
+    }
+
+private:
+    std::atomic<int> mode{ static_cast<int>(Mode::mid) };
+    std::atomic<int> selectedChannel{ 0 };
+};
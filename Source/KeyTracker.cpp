@@ -0,0 +1,124 @@
+#include "KeyTracker.h"
+#include <cmath>
+
+namespace {
+    // Krumhansl-Kessler probe tone profiles, index 0 is the tonic
+    constexpr float majorProfile[12] = { 6.35f, 2.23f, 3.48f, 2.33f, 4.38f, 4.09f, 2.52f, 5.19f, 2.39f, 3.66f, 2.29f, 2.88f };
+    constexpr float minorProfile[12] = { 6.33f, 2.68f, 3.52f, 5.38f, 2.60f, 3.53f, 2.54f, 4.75f, 3.98f, 2.69f, 3.34f, 3.17f };
+
+    constexpr bool majorScale[12] = { true, false, true, false, true, true, false, true, false, true, false, true };
+    constexpr bool minorScale[12] = { true, false, true, true, false, true, false, true, true, false, true, true };
+
+    const char* const pitchClassNames[12] = { "C", "C#", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B" };
+
+    // sum and centred sum of squares of a profile, the same for every rotation
+    struct ProfileStats {
+        float sum = 0.0f;
+        float centredSquares = 0.0f;
+    };
+
+    ProfileStats getStats(const float (&profile)[12]) {
+        ProfileStats stats;
+        float squares = 0.0f;
+        for (const float value : profile) {
+            stats.sum += value;
+            squares += value * value;
+        }
+        stats.centredSquares = squares - stats.sum * stats.sum / 12.0f;
+        return stats;
+    }
+
+    const ProfileStats majorStats = getStats(majorProfile);
+    const ProfileStats minorStats = getStats(minorProfile);
+}
+
+void KeyTracker::reset() noexcept {
+    histogram.fill(0.0f);
+    dot.fill(0.0f);
+    sum = 0.0f;
+    sumOfSquares = 0.0f;
+    totalWeight = 0.0f;
+}
+
+void KeyTracker::addNote(int midiNote, float weight) noexcept {
+    if (midiNote < 0 || weight <= 0.0f) return;
+
+    // fade everything already in, scaling keeps every running sum consistent
+    for (auto& bin : histogram) bin *= decay;
+    for (auto& value : dot) value *= decay;
+    sum *= decay;
+    sumOfSquares *= decay * decay;
+    totalWeight *= decay;
+
+    const int pitchClass = midiNote % 12;
+    const float before = histogram[static_cast<size_t>(pitchClass)];
+    histogram[static_cast<size_t>(pitchClass)] = before + weight;
+
+    sum += weight;
+    sumOfSquares += 2.0f * before * weight + weight * weight;
+    totalWeight += weight;
+
+    // the new weight lands on a different profile degree for every tonic
+    for (int tonic = 0; tonic < 12; ++tonic) {
+        const int degree = (pitchClass - tonic + 12) % 12;
+        dot[static_cast<size_t>(tonic)] += weight * majorProfile[degree];
+        dot[static_cast<size_t>(tonic + 12)] += weight * minorProfile[degree];
+    }
+}
+
+void KeyTracker::prime(const Key& key, float weight) noexcept {
+    reset();
+    if (weight <= 0.0f) return;
+
+    const auto& profile = key.minor ? minorProfile : majorProfile;
+    const float scale = weight / (key.minor ? minorStats : majorStats).sum;
+    for (int pitchClass = 0; pitchClass < 12; ++pitchClass) {
+        const float binWeight = scale * profile[(pitchClass - key.tonic % 12 + 12) % 12];
+        histogram[static_cast<size_t>(pitchClass)] = binWeight;
+        sum += binWeight;
+        sumOfSquares += binWeight * binWeight;
+
+        for (int tonic = 0; tonic < 12; ++tonic) {
+            const int degree = (pitchClass - tonic + 12) % 12;
+            dot[static_cast<size_t>(tonic)] += binWeight * majorProfile[degree];
+            dot[static_cast<size_t>(tonic + 12)] += binWeight * minorProfile[degree];
+        }
+    }
+    totalWeight = weight;
+}
+
+KeyTracker::Key KeyTracker::getKey() const noexcept {
+    Key best;
+    best.correlation = -1.0f;
+
+    const float centredSquares = sumOfSquares - sum * sum / 12.0f;
+    if (centredSquares <= 1.0e-9f) {
+        best.correlation = 0.0f;
+        return best;
+    }
+
+    for (int key = 0; key < numKeys; ++key) {
+        const auto& stats = key < 12 ? majorStats : minorStats;
+        const float covariance = dot[static_cast<size_t>(key)] - sum * stats.sum / 12.0f;
+        const float correlation = covariance / std::sqrt(centredSquares * stats.centredSquares);
+
+        if (correlation > best.correlation) {
+            best.tonic = key % 12;
+            best.minor = key >= 12;
+            best.correlation = correlation;
+        }
+    }
+    return best;
+}
+
+std::array<float, 12> KeyTracker::makePitchClassBias(const Key& key, float outOfKeyPenalty) {
+    std::array<float, 12> bias{};
+    const auto& scale = key.minor ? minorScale : majorScale;
+    for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+        bias[static_cast<size_t>(pitchClass)] = scale[(pitchClass - key.tonic + 12) % 12] ? 0.0f : outOfKeyPenalty;
+    return bias;
+}
+
+juce::String KeyTracker::getKeyName(const Key& key) {
+    return juce::String(pitchClassNames[key.tonic % 12]) + (key.minor ? " minor" : " major");
+}
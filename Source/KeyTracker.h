@@ -0,0 +1,48 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+// Running key estimate from the notes the singer has been capturing. Every note goes into a
+// pitch-class histogram and the 24 Krumhansl-Kessler correlations are updated along with it, so
+// adding a note and asking for the key are both constant time whatever the session length.
+// Older notes fade out slowly, a modulation takes over after a couple of phrases.
+//
+// Not thread safe, keep it on the thread that feeds it.
+class KeyTracker {
+public:
+    struct Key {
+        int tonic = 0;            // pitch class, 0 = C
+        bool minor = false;
+        float correlation = 0.0f; // -1..1, how well the notes fit this key's profile
+    };
+
+    KeyTracker() { reset(); }
+
+    void reset() noexcept;
+
+    // weight is usually the note's length in slots
+    void addNote(int midiNote, float weight = 1.0f) noexcept;
+
+    // Starts over from key's own profile worth weight slots of notes, for a key that was saved
+    // rather than sung. getKey returns it until enough new notes say otherwise.
+    void prime(const Key& key, float weight) noexcept;
+
+    Key getKey() const noexcept;
+    float getTotalWeight() const noexcept { return totalWeight; }
+
+    // Additive log-probability per pitch class: 0 in the key's scale, outOfKeyPenalty elsewhere.
+    // Minor allows both the natural and the raised seventh.
+    static std::array<float, 12> makePitchClassBias(const Key& key, float outOfKeyPenalty);
+
+    static juce::String getKeyName(const Key& key);
+
+private:
+    static constexpr int numKeys = 24;  // 12 major then 12 minor
+    static constexpr float decay = 0.985f;  // per added note
+
+    std::array<float, 12> histogram{};
+    std::array<float, numKeys> dot{};  // histogram . rotated profile, per key
+    float sum = 0.0f;
+    float sumOfSquares = 0.0f;
+    float totalWeight = 0.0f;
+};
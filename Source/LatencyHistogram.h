@@ -0,0 +1,89 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+// HDR-style latency histogram in microseconds. Below 32 us every value has its own bucket, above
+// that each power of two is split into 16 linear buckets, so any percentile is within ~6% of the
+// real value from 1 us up to over an hour. Recording is a couple of relaxed atomic increments and
+// never allocates or locks, any thread may record while another one reads.
+class LatencyHistogram {
+public:
+    struct Summary {
+        juce::uint64 count = 0;
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    void record(double seconds) noexcept {
+        const auto micros = static_cast<juce::uint32>(juce::jlimit(0.0, 4.0e9, seconds * 1.0e6));
+
+        buckets[getBucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+
+        auto currentMax = maxMicros.load(std::memory_order_relaxed);
+        while (micros > currentMax && !maxMicros.compare_exchange_weak(currentMax, micros, std::memory_order_relaxed)) {}
+    }
+
+    // Upper edge of the bucket the percentile falls into, clamped to the recorded maximum
+    double getPercentileMs(double percentile) const noexcept {
+        const auto count = total.load(std::memory_order_relaxed);
+        if (count == 0) return 0.0;
+
+        const auto target = juce::jmax<juce::uint64>(1, static_cast<juce::uint64>(std::ceil(percentile * 0.01 * static_cast<double>(count))));
+        const auto maxValue = maxMicros.load(std::memory_order_relaxed);
+        juce::uint64 seen = 0;
+
+        for (size_t i = 0; i < numBuckets; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+                return static_cast<double>(juce::jmin(getBucketUpperEdge(i), maxValue)) * 0.001;
+        }
+        return static_cast<double>(maxValue) * 0.001;
+    }
+
+    Summary getSummary() const noexcept {
+        return { total.load(std::memory_order_relaxed), getPercentileMs(50.0), getPercentileMs(99.0),
+                 static_cast<double>(maxMicros.load(std::memory_order_relaxed)) * 0.001 };
+    }
+
+    juce::uint64 getCount() const noexcept { return total.load(std::memory_order_relaxed); }
+
+    // Not synchronised with concurrent records, a value landing mid-reset may survive it
+    void reset() noexcept {
+        for (auto& bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        maxMicros.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int subBucketBits = 4;
+    static constexpr juce::uint32 subBuckets = 1u << subBucketBits;
+    static constexpr size_t numBuckets = (33 - subBucketBits) * subBuckets;
+
+    static size_t getBucketIndex(juce::uint32 micros) noexcept {
+        if (micros < 2 * subBuckets) return micros;
+
+        int highestBit = 0;
+        for (auto v = micros; v > 1; v >>= 1)
+            ++highestBit;
+
+        const int shift = highestBit - subBucketBits;
+        return static_cast<size_t>(shift) * subBuckets + (micros >> shift);
+    }
+
+    static juce::uint32 getBucketUpperEdge(size_t index) noexcept {
+        if (index < 2 * subBuckets) return static_cast<juce::uint32>(index);
+
+        const auto shift = static_cast<juce::uint32>(index / subBuckets - 1);
+        const auto lowerEdge = static_cast<juce::uint64>(index % subBuckets + subBuckets) << shift;
+        return static_cast<juce::uint32>(juce::jmin<juce::uint64>(lowerEdge + (1ull << shift) - 1, 0xffffffffull));
+    }
+
+    std::array<std::atomic<juce::uint32>, numBuckets> buckets{};
+    std::atomic<juce::uint64> total{ 0 };
+    std::atomic<juce::uint32> maxMicros{ 0 };
+};
@@ -0,0 +1,151 @@
+#include "MelodyCapture.h"
+#include "Trace.h"
+
+MelodyCapture::MelodyCapture(int length)
+    : phraseLength(juce::jlimit(1, maxPhraseLength, length))
+{
+    phrase.fill(-2);
+    slotSamples.fill(-1);
+}
+
+void MelodyCapture::pushFrame(int midiNote, float confidence, juce::int64 onsetSample) {
+    CT_TRACE_SCOPE("captureGate");
+
+    if (onsetSample >= 0) {
+        pendingOnset = onsetSample;
+        pendingOnsetFrames = framesToConfirmNote + 1;
+    }
+    else if (pendingOnsetFrames > 0 && --pendingOnsetFrames == 0) {
+        pendingOnset = -1;
+    }
+
+    const bool frameVoiced = juce::isPositiveAndBelow(midiNote, 128)
+        && confidence >= (voiced ? offConfidence : onConfidence);
+
+    if (!frameVoiced) {
+        if (voiced) {
+            voiced = false;
+            currentNote = -1;
+            candidateFrames = 0;
+            publishSegment();
+        }
+        return;
+    }
+
+    // Start of a voiced segment, report it straight away
+    if (!voiced) {
+        voiced = true;
+        currentNote = midiNote;
+        lastOnNote = midiNote;
+        candidateFrames = 0;
+        ++noteOns;
+        takeOnset();
+        publishSegment();
+        return;
+    }
+
+    if (midiNote == currentNote) {
+        candidateFrames = 0;
+        return;
+    }
+
+    // Legato note change, has to persist so vibrato and octave blips don't retrigger
+    if (midiNote != candidateNote) {
+        candidateNote = midiNote;
+        candidateFrames = 0;
+    }
+
+    if (++candidateFrames >= framesToConfirmNote) {
+        currentNote = midiNote;
+        lastOnNote = midiNote;
+        candidateFrames = 0;
+        ++noteOns;
+        takeOnset();
+        publishSegment();
+    }
+}
+
+void MelodyCapture::takeOnset() {
+    noteOnset = pendingOnset;
+    pendingOnset = -1;
+    pendingOnsetFrames = 0;
+}
+
+int MelodyCapture::frequencyToMidiNote(float frequency) {
+    if (frequency <= 0) return -1;
+    float midiNote = 69.0f + 12.0f * (std::log(frequency / 440.0f) / std::log(2.0f));
+    return static_cast<int>(std::round(midiNote));
+}
+
+void MelodyCapture::publishSegment() {
+    onsetState.store((static_cast<juce::uint64>(noteOns & 0xffff) << 48)
+        | (static_cast<juce::uint64>(noteOnset + 1) & 0xffffffffffffull), std::memory_order_relaxed);
+    const auto state = (static_cast<juce::uint64>(noteOns) << 32)
+        | (static_cast<juce::uint64>(lastOnNote + 1) << 8)
+        | static_cast<juce::uint64>(currentNote + 1);
+    segmentState.store(state, std::memory_order_release);
+}
+
+bool MelodyCapture::captureSlot(int phrasePosition, juce::int64 slotSample) {
+    const auto state = segmentState.load(std::memory_order_acquire);
+    const auto ons = static_cast<juce::uint32>(state >> 32);
+    const int onNote = static_cast<int>((state >> 8) & 0xff) - 1;
+    const int note = static_cast<int>(state & 0xff) - 1;
+
+    const auto onsetBits = onsetState.load(std::memory_order_relaxed);
+    const juce::int64 onset = (onsetBits >> 48) == (ons & 0xffff)
+        ? static_cast<juce::int64>(onsetBits & 0xffffffffffffull) - 1 : -1;
+
+    int event = -2;
+    if (ons != lastNoteOns && onNote >= 0) {
+        // a note started since the last slot, even if it already ended again
+        event = onNote;
+        slotSounding = true;
+    }
+    else if (note < 0 && slotSounding) {
+        event = -1;
+        slotSounding = false;
+    }
+    lastNoteOns = ons;
+
+    if (phrasePosition == 0)
+        slotsCaptured = 0;
+
+    if (!juce::isPositiveAndBelow(phrasePosition, phraseLength) || slotsCaptured != phrasePosition) {
+        // joined mid-phrase or skipped a slot, wait for the next phrase start
+        slotsCaptured = -1;
+        return false;
+    }
+
+    slotSamples[static_cast<size_t>(phrasePosition)] = slotSample;
+
+    // a note that was only recognised after its slot went by moves back to the boundary nearest
+    // its onset, as long as that doesn't overwrite another note
+    if (event >= 0 && onset >= 0 && slotSample >= 0) {
+        int target = phrasePosition;
+        while (target > 0 && phrasePosition - target < maxSnapBack && phrase[static_cast<size_t>(target - 1)] < 0) {
+            const auto previous = slotSamples[static_cast<size_t>(target - 1)];
+            const auto boundary = slotSamples[static_cast<size_t>(target)];
+            if (previous < 0 || onset >= previous + (boundary - previous) / 2)
+                break;
+            --target;
+        }
+
+        if (target < phrasePosition) {
+            phrase[static_cast<size_t>(target)] = event;
+            for (int slot = target + 1; slot < phrasePosition; ++slot)
+                phrase[static_cast<size_t>(slot)] = -2;
+            event = -2;
+        }
+    }
+
+    phrase[static_cast<size_t>(phrasePosition)] = event;
+    ++slotsCaptured;
+
+    return slotsCaptured == phraseLength;
+}
+
+void MelodyCapture::reset() {
+    slotsCaptured = -1;
+    slotSamples.fill(-1);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+// Incremental capture of the sung phrase. The pitch thread feeds one MIDI note per analysed frame
+// and the segmenter turns that into voiced/unvoiced segments with hysteresis on both confidence
+// and note changes. At every sixteenth boundary the audio thread turns the segment state into one
+// event: the note for a note-on, -1 when the voice stopped, -2 to hold. Both sides are O(1) and
+// only share a single packed atomic, plus the onset time of the latest note when the pitch path
+// found one, which lets a note that was recognised late snap back to the slot it started in.
+class MelodyCapture {
+public:
+    static constexpr int maxPhraseLength = 256;
+
+    explicit MelodyCapture(int phraseLength);
+
+    // Pitch thread: one call per analysed frame, midiNote < 0 for no pitch. onsetSample is the
+    // frame's onset (PitchDetector::Frame::onsetSample) on the pitch path's sample timeline
+    void pushFrame(int midiNote, float confidence, juce::int64 onsetSample = -1);
+
+    // Nearest MIDI note, -1 for no pitch
+    static int frequencyToMidiNote(float frequency);
+
+    // Audio thread: one call per sixteenth boundary, returns true when this slot completed a phrase.
+    // slotSample is the boundary on the same timeline as the onsets, -1 when not known
+    bool captureSlot(int phrasePosition, juce::int64 slotSample = -1);
+
+    // Audio thread: drops the partial phrase, capture resumes at the next phrase start
+    void reset();
+
+    const int* getPhrase() const { return phrase.data(); }
+    int getPhraseLength() const { return phraseLength; }
+    bool isNoteActive() const { return slotSounding; }
+
+private:
+    static constexpr float onConfidence = 0.5f;   // voicing starts above this
+    static constexpr float offConfidence = 0.3f;  // ... and only ends below this
+    static constexpr int framesToConfirmNote = 2; // a different note has to hold this long to count
+    static constexpr int maxSnapBack = 2;         // slots a late note can move back
+
+    // pitch thread
+    bool voiced = false;
+    int currentNote = -1;
+    int lastOnNote = -1;
+    int candidateNote = -1;
+    int candidateFrames = 0;
+    juce::uint32 noteOns = 0;
+    juce::int64 pendingOnset = -1;  // goes to the next note on, if it comes within a few frames
+    int pendingOnsetFrames = 0;
+    juce::int64 noteOnset = -1;
+    void publishSegment();
+    void takeOnset();
+
+    // noteOns << 32 | (lastOnNote + 1) << 8 | (currentNote + 1)
+    std::atomic<juce::uint64> segmentState{ 0 };
+    // (noteOns & 0xffff) << 48 | (onset + 1), written before segmentState. a reader only trusts it
+    // when the count matches the state it read
+    std::atomic<juce::uint64> onsetState{ 0 };
+
+    // audio thread
+    std::array<int, maxPhraseLength> phrase{};
+    std::array<juce::int64, maxPhraseLength> slotSamples;  // -1 = not captured yet
+    int phraseLength;
+    int slotsCaptured = -1;  // contiguous slots since the phrase start, -1 until the next one
+    juce::uint32 lastNoteOns = 0;
+    bool slotSounding = false;
+};
@@ -1,257 +1,465 @@
 // MelodyGenerator.cpp
 #include "MelodyGenerator.h"
+#include "Trace.h"
 #include <sstream>
 #include <numeric>
 
-MelodyGenerator::MelodyGenerator()
+template <typename Spec>
+BasicMelodyGenerator<Spec>::BasicMelodyGenerator()
     : env(ORT_LOGGING_LEVEL_WARNING, "MelodyGenerator"),
     memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
     generator(std::random_device{}()) {
+    classScale.fill(1.0f);
 }
 
-MelodyGenerator::~MelodyGenerator() {
+template <typename Spec>
+BasicMelodyGenerator<Spec>::~BasicMelodyGenerator() {
+    // a swap still loading doesn't publish into a generator that's going away, queued ones are
+    // dropped and report failure through their completion
+    shuttingDown.store(true);
+    loaderPool.removeAllJobs(false, -1);
+}
+
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::setPitchClassBias(const std::array<float, 12>& bias) {
+    std::array<float, 12> scale;
+    for (size_t pc = 0; pc < 12; ++pc)
+        scale[pc] = expf(bias[pc]);
+
+    for (int c = 0; c < Spec::numClasses; ++c) {
+        const int event = Spec::indexToEvent(c);
+        classScale[static_cast<size_t>(c)] = event < 0 ? 1.0f : scale[static_cast<size_t>(event % 12)];
+    }
+}
+
+template <typename Spec>
+bool BasicMelodyGenerator<Spec>::initialize(const void* modelData, size_t modelDataLength) {
+    auto newModel = createModel(modelData, modelDataLength);
+    if (!newModel) return false;
 
+    std::atomic_store(&model, newModel);
+    DBG("Model initialized successfully");
+    return true;
 }
 
-bool MelodyGenerator::initialize(const void* modelData, size_t modelDataLength) {
+template <typename Spec>
+std::shared_ptr<typename BasicMelodyGenerator<Spec>::Model> BasicMelodyGenerator<Spec>::createModel(const void* modelData, size_t modelDataLength) {
     try {
         // create session options
         Ort::SessionOptions sessionOptions;
         sessionOptions.SetIntraOpNumThreads(1);
         sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_BASIC);
+        if (lowMemory.load())
+            sessionOptions.DisableCpuMemArena();
+
+        auto newModel = std::make_shared<Model>();
 
         // create session from model data
-        session = std::make_unique<Ort::Session>(env, modelData, modelDataLength, sessionOptions);
+        MemoryAccounting::ScopedLoadMeasurement measurement;
+        newModel->session = std::make_unique<Ort::Session>(env, modelData, modelDataLength, sessionOptions);
+        auto& session = newModel->session;
 
         // verify input shape
         auto inputCount = session->GetInputCount();
         if (inputCount != 1) {
-            lastError = "Expected 1 input, got " + std::to_string(inputCount);
-            DBG(lastError);
-            return false;
+            setLastError("Expected 1 input, got " + std::to_string(inputCount));
+            return nullptr;
         }
 
         auto inputInfo = session->GetInputTypeInfo(0);
         auto inputTensorInfo = inputInfo.GetTensorTypeAndShapeInfo();
         auto inputShape = inputTensorInfo.GetShape();
 
-        if (inputShape.size() != 3 || inputShape[0] != 128 || inputShape[1] != 32 || inputShape[2] != 130) {
-            lastError = "Invalid input shape";
-            DBG(lastError);
-            return false;
+        if (!Spec::matchesInput(inputShape)) {
+            setLastError("Invalid input shape, expected " + Spec::describe());
+            return nullptr;
         }
 
-        DBG("Model initialized successfully");
-        return true;
+        newModel->inputName = session->GetInputNameAllocated(0, allocator).get();
+        newModel->outputName = session->GetOutputNameAllocated(0, allocator).get();
+
+        // allocate the io buffers once, generateMelody reuses them
+        newModel->batchInput.assign(Spec::inputSize, 0.0f);
+
+        newModel->outputShape = session->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (!Spec::matchesOutput(newModel->outputShape)) {
+            setLastError("Invalid output shape, expected " + Spec::describe());
+            return nullptr;
+        }
+        size_t outputSize = 1;
+        for (auto dim : newModel->outputShape)
+            outputSize = dim > 0 ? outputSize * static_cast<size_t>(dim) : 0;
+        newModel->outputBuffer.assign(outputSize, 0.0f);
+        newModel->sessionBytes.store(measurement.getGrowth());
+
+        return newModel;
     }
     catch (const Ort::Exception& e) {
-        lastError = "ONNX Runtime error: " + std::string(e.what());
-        DBG(lastError);
-        return false;
+        setLastError("ONNX Runtime error: " + std::string(e.what()));
+        return nullptr;
     }
     catch (const std::exception& e) {
-        lastError = "Initialization error: " + std::string(e.what());
-        DBG(lastError);
-        return false;
+        setLastError("Initialization error: " + std::string(e.what()));
+        return nullptr;
     }
 }
 
-std::vector<float> MelodyGenerator::eventsToOnehot(const std::vector<int>& events) {
-    const int seqLength = 32;
-    const int numClasses = 130;
-    std::vector<float> onehot(seqLength * numClasses, 0.0f);
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::hotSwapModel(const void* modelData, size_t modelDataLength, std::function<void(bool)> onComplete) {
+    // ORT is done with the bytes once the session exists, the copy only has to outlive the job
+    juce::MemoryBlock data(modelData, modelDataLength);
 
-    for (int i = 0; i < seqLength && i < events.size(); ++i) {
-        int event = events[i];
-        int index = (event == -1) ? 0 : (event == -2) ? 1 : event + 2;
-        if (index >= 0 && index < numClasses) {
-            onehot[i * numClasses + index] = 1.0f;
-        }
-    }
+    auto completion = std::make_shared<HotSwapCompletion>(std::move(onComplete));
+
+    loaderPool.addJob([this, data, completion] {
+        auto newModel = createModel(data.getData(), data.getSize());
+        bool loaded = newModel != nullptr && !shuttingDown.load();
+
+        if (loaded) {
+            try {
+                const double latencyMs = warmUpModel(*newModel, 3);
+                auto oldModel = std::atomic_exchange(&model, newModel);
+                newModel.reset();
 
-    // Debug: Check a few entries
-    std::string onehotDbg = "First few onehot values: ";
-    for (int i = 0; i < std::min(5, seqLength); ++i) {
-        int idx = i * numClasses;
-        for (int j = 0; j < numClasses; ++j) {
-            if (onehot[idx + j] == 1.0f) {
-                onehotDbg += std::to_string(j) + " ";
-                break;
+                steadyStateLatencyMs.store(latencyMs);
+                DBG("Melody model swapped");
+                retireModel(std::move(oldModel));
+            }
+            catch (const Ort::Exception& e) {
+                setLastError("ONNX Runtime error during warm-up: " + std::string(e.what()));
+                loaded = false;
             }
         }
+
+        completion->complete(loaded);
+    });
+}
+
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::retireModel(std::shared_ptr<Model> oldModel) {
+    std::atomic_exchange(&retiredModel, std::move(oldModel));
+}
+
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::setLastError(const std::string& error) {
+    DBG(error);
+    const RealtimeGuard::CheckedCriticalSection::ScopedLockType lock(errorLock);
+    lastError = error;
+}
+
+template <typename Spec>
+std::string BasicMelodyGenerator<Spec>::getLastError() const {
+    const RealtimeGuard::CheckedCriticalSection::ScopedLockType lock(errorLock);
+    return lastError;
+}
+
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::eventsToOnehot(const int* events, int numEvents, float* row) {
+    CT_TRACE_SCOPE("onehotEncode");
+    constexpr size_t numClasses = Spec::numClasses;
+    std::fill_n(row, Spec::phraseSize, 0.0f);
+
+    numEvents = std::min(Spec::seqLength, numEvents);
+    for (int i = 0; i < numEvents; ++i) {
+        const int index = Spec::eventToIndex(events[i]);
+        if (index >= 0 && index < Spec::numClasses)
+            row[static_cast<size_t>(i) * numClasses + static_cast<size_t>(index)] = 1.0f;
     }
-    DBG(onehotDbg);
-    return onehot;
 }
 
-std::vector<float> MelodyGenerator::createBatchInput(const std::vector<float>& onehot, int batchSize) {
-    const int seqLength = 32;
-    const int numClasses = 130;
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::createBatchInput(const std::vector<int>& events, std::vector<float>& batch) {
+    CT_TRACE_SCOPE("batchInput");
 
-    const size_t totalSize = batchSize * seqLength * numClasses;
+    // already the right size after initialize, so this doesn't allocate
+    batch.resize(Spec::inputSize);
 
-    // preallocate w corr size
-    std::vector<float> batchInput(totalSize, 0.0f);
+    // encode straight into the first row and copy it to the others
+    eventsToOnehot(events.data(), static_cast<int>(events.size()), batch.data());
+    for (int b = 1; b < Spec::batchSize; ++b)
+        std::copy_n(batch.data(), Spec::phraseSize, batch.data() + b * Spec::phraseSize);
+}
 
-    // copy the onehot vector for each batch
-    for (int b = 0; b < batchSize; ++b) {
-        const size_t offset = b * seqLength * numClasses;
-        std::copy(onehot.begin(), onehot.end(), batchInput.begin() + offset);
+template <typename Spec>
+const float* BasicMelodyGenerator<Spec>::runModel(Model& m, int rows) {
+    CT_TRACE_SCOPE("melodyRun");
+    static constexpr auto inputShape = Spec::inputShape();
+    Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
+        memoryInfo,
+        m.batchInput.data(),
+        m.batchInput.size(),
+        inputShape.data(),
+        inputShape.size()
+    );
+
+    const char* inputNames[] = { m.inputName.c_str() };
+    const char* outputNames[] = { m.outputName.c_str() };
+
+    if (!m.outputBuffer.empty()) {
+        Ort::Value outputTensor = Ort::Value::CreateTensor<float>(
+            memoryInfo,
+            m.outputBuffer.data(),
+            m.outputBuffer.size(),
+            m.outputShape.data(),
+            m.outputShape.size()
+        );
+        m.session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputTensor, 1, outputNames, &outputTensor, 1);
+        return m.outputBuffer.data();
     }
 
-    DBG("Batch input created with size: " + std::to_string(batchInput.size()));
-    return batchInput;
+    // dynamic output shape, let ORT allocate and keep the value alive until the next run
+    m.dynamicOutputs = m.session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputTensor, 1, outputNames, 1);
+    if (m.dynamicOutputs.empty()) return nullptr;
+
+    // the dynamic dimensions weren't checked at load time, at least the rows asked for have to be there
+    Ort::Value& output = m.dynamicOutputs[0];
+    if (output.GetTensorTypeAndShapeInfo().GetElementCount() < Spec::phraseSize * static_cast<size_t>(rows)) return nullptr;
+    return output.GetTensorMutableData<float>();
 }
 
-std::string MelodyGenerator::eventsToString(const std::vector<int>& events) {
-    std::string s;
-    for (int e : events) s += std::to_string(e) + " ";
-    return s;
+template <typename Spec>
+const float* BasicMelodyGenerator<Spec>::generateWindowed(Model& m, const std::vector<int>& events) {
+    CT_TRACE_SCOPE("melodyWindowed");
+    constexpr int seqLength = Spec::seqLength;
+    constexpr size_t numClasses = Spec::numClasses;
+
+    const int length = static_cast<int>(events.size());
+    const int numWindows = (length - seqLength + windowHop - 1) / windowHop + 1;
+    const auto windowStart = [&](int w) { return juce::jmin(w * windowHop, length - seqLength); };
+
+    windowProbs.assign(static_cast<size_t>(length) * numClasses, 0.0f);
+    windowWeights.assign(static_cast<size_t>(length), 0.0f);
+    m.batchInput.resize(Spec::inputSize);
+
+    for (int first = 0; first < numWindows; first += Spec::batchSize) {
+        const int rows = juce::jmin(Spec::batchSize, numWindows - first);
+
+        // one window per row, rows past the last window keep whatever they had and are ignored
+        for (int r = 0; r < rows; ++r)
+            eventsToOnehot(events.data() + windowStart(first + r), seqLength, m.batchInput.data() + static_cast<size_t>(r) * Spec::phraseSize);
+
+        const float* output = runModel(m, rows);
+        if (output == nullptr) return nullptr;
+
+        for (int r = 0; r < rows; ++r) {
+            const float* rowOutput = output + static_cast<size_t>(r) * Spec::phraseSize;
+            const int start = windowStart(first + r);
+
+            for (int i = 0; i < seqLength; ++i) {
+                // triangular, the middle of a window is the part with the most context on both sides
+                const float weight = static_cast<float>(juce::jmin(i + 1, seqLength - i));
+                float* dest = windowProbs.data() + static_cast<size_t>(start + i) * numClasses;
+                juce::FloatVectorOperations::addWithMultiply(dest, rowOutput + static_cast<size_t>(i) * numClasses, weight, Spec::numClasses);
+                windowWeights[static_cast<size_t>(start + i)] += weight;
+            }
+        }
+    }
+
+    for (int t = 0; t < length; ++t)
+        juce::FloatVectorOperations::multiply(windowProbs.data() + static_cast<size_t>(t) * numClasses,
+                                              1.0f / windowWeights[static_cast<size_t>(t)], Spec::numClasses);
+
+    return windowProbs.data();
+}
+
+template <typename Spec>
+double BasicMelodyGenerator<Spec>::warmUpModel(Model& m, int iterations) {
+    // an empty phrase is as good as any, only the shape matters for arena sizing
+    std::vector<int> holds(Spec::seqLength, Spec::hold);
+    createBatchInput(holds, m.batchInput);
+
+    // the arena grows to the peak these runs need and ORT keeps it reserved afterwards
+    MemoryAccounting::ScopedLoadMeasurement measurement;
+    double lastMs = 0.0;
+    for (int i = 0; i < iterations && !juce::Thread::currentThreadShouldExit(); ++i) {
+        const double startMs = juce::Time::getMillisecondCounterHiRes();
+        runModel(m);
+        lastMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+        if (i == 0)
+            DBG("Melody model first run: " + juce::String(lastMs, 2) + " ms");
+    }
+
+    m.sessionBytes.fetch_add(measurement.getGrowth());
+    DBG("Melody model warmed up, steady state: " + juce::String(lastMs, 2) + " ms");
+    return lastMs;
+}
+
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::warmUp(int iterations) {
+    auto activeModel = std::atomic_load(&model);
+    if (!activeModel) return;
+
+    try {
+        steadyStateLatencyMs.store(warmUpModel(*activeModel, iterations));
+        warmedUp.store(true);
+    }
+    catch (const Ort::Exception& e) {
+        setLastError("ONNX Runtime error during warm-up: " + std::string(e.what()));
+    }
 }
 
-std::vector<int> MelodyGenerator::generateMelody(std::vector<int>& events, float temperature, int steps)
+template <typename Spec>
+std::vector<int> BasicMelodyGenerator<Spec>::generateMelody(std::vector<int>& events, float temperature, int steps)
 {
 
+    CT_TRACE_SCOPE("generateMelody");
+
+    // the previous run's reference is gone, a model swapped out since can go now
+    std::atomic_exchange(&retiredModel, std::shared_ptr<Model>());
+
+    const auto seed = pendingSeed.exchange(-1);
+    if (seed >= 0)
+        generator.seed(static_cast<uint32_t>(seed));
+
     try {
 
-        if (!session) {
+        // hold on to the model for the whole run, a hot swap in the meantime only affects the next one
+        auto activeModel = std::atomic_load(&model);
+        if (!activeModel) {
             DBG("Error: Model not initialized");
             return std::vector<int>();
         }
         
         // step 1: convert text to events... calready accounted for
-        if (events.size() < 32) {
-            events.resize(32, -2);  // Use resize instead of insert
-        }
-        else if (events.size() > 32) {
-            events.resize(32);
+        steps = juce::jmax(0, steps);
+        events.resize(static_cast<size_t>(juce::jmax(Spec::seqLength, steps)), Spec::hold);
+
+        if (events.size() > static_cast<size_t>(Spec::seqLength)) {
+            const float* stitched = generateWindowed(*activeModel, events);
+            if (stitched == nullptr) {
+                DBG("Error: No output tensors");
+                return std::vector<int>();
+            }
+            auto generated = sampleEvents(stitched, steps, temperature);
+            releaseScratch();
+            return generated;
         }
-        DBG("Padded events: " + eventsToString(events));
 
 
-        // step 2: convert to one-hot
-        std::vector<float> onehot = eventsToOnehot(events);
-
-        // step 3: create batch input with explicit size
-        const size_t batchSize = 128;
-        const size_t seqLength = 32;
-        const size_t numClasses = 130;
-        std::vector<float> batchInput = createBatchInput(onehot, batchSize);
+        // step 2 + 3: one-hot encode into the preallocated batch input
+        auto& batchInput = activeModel->batchInput;
+        createBatchInput(events, batchInput);
 
         // verify batch input size
-        if (batchInput.size() != batchSize * seqLength * numClasses) {
+        if (batchInput.size() != Spec::inputSize) {
             DBG("Error: Invalid batch input size");
             return std::vector<int>();
         }
 
-        // step 4: prepare input tensor
-        std::vector<int64_t> inputShape = { batchSize, seqLength, numClasses };
-        Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
-            memoryInfo,
-            batchInput.data(),
-            batchInput.size(),
-            inputShape.data(),
-            inputShape.size()
-        );
-
-        // step 5: run the model
-        auto inputName = session->GetInputNameAllocated(0, allocator);
-        auto outputName = session->GetOutputNameAllocated(0, allocator);
-
-        const char* inputNames[] = { inputName.get() };
-        const char* outputNames[] = { outputName.get() };
-
-        std::vector<Ort::Value> outputTensors = session->Run(
-            Ort::RunOptions{ nullptr },
-            inputNames,
-            &inputTensor,
-            1,
-            outputNames,
-            1
-        );
+        // step 4 + 5: run the model on the preallocated input
+        const double startMs = juce::Time::getMillisecondCounterHiRes();
+        const float* outputData = runModel(*activeModel);
+        if (!firstRunLogged) {
+            firstRunLogged = true;
+            DBG("First real generation: " + juce::String(juce::Time::getMillisecondCounterHiRes() - startMs, 2)
+                + " ms (steady state " + juce::String(steadyStateLatencyMs.load(), 2) + " ms)");
+        }
 
         // step 6: process output
-        if (outputTensors.empty()) {
+        if (outputData == nullptr) {
             DBG("Error: No output tensors");
             return std::vector<int>();
         }
 
-        float* outputData = outputTensors[0].GetTensorMutableData<float>();
-        std::vector<float> outputProbs(seqLength * numClasses);
-        std::copy(outputData, outputData + seqLength * numClasses, outputProbs.begin());
-
         // step 7:  generate events
-        std::vector<int> generatedEvents;
-        generatedEvents.reserve(steps);
+        auto generated = sampleEvents(outputData, steps, temperature);
+        releaseScratch();
+        return generated;
 
+    }
+    catch (const Ort::Exception& e) {
+        DBG("ONNX Runtime error: " + std::string(e.what()));
+        return std::vector<int>();
+    }
+    catch (const std::exception& e) {
+        DBG("Generation error: " + std::string(e.what()));
+        return std::vector<int>();
+    }
 
-        for (int t = 0; t < steps; ++t) {
-            std::vector<float> stepProbs(numClasses);
-            std::copy(outputProbs.begin() + t * numClasses,
-                outputProbs.begin() + (t + 1) * numClasses,
-                stepProbs.begin());
+    
+    
+    //    return std::vector<int>();
+}
 
-            // Normalize probabilities
-            float sumProbs = std::accumulate(stepProbs.begin(), stepProbs.end(), 0.0f);
-            if (sumProbs > 0) {
-                for (float& p : stepProbs) {
-                    p /= sumProbs;
-                }
-            }
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::releaseScratch() {
+    if (lowMemory.load()) {
+        std::vector<float>().swap(windowProbs);
+        std::vector<float>().swap(windowWeights);
+    }
+    scratchBytes.store(MemoryAccounting::bytesOf(windowProbs) + MemoryAccounting::bytesOf(windowWeights), std::memory_order_relaxed);
+}
 
-            // Apply temperature scaling
-            if (temperature != 0.8f) {
-                std::vector<float> logits(numClasses);
-                for (size_t c = 0; c < numClasses; ++c) {
-                    logits[c] = logf(std::max(stepProbs[c], 1e-7f));
-                }
+template <typename Spec>
+void BasicMelodyGenerator<Spec>::addMemoryUsage(MemoryAccounting::Report& report) const {
+    if (auto activeModel = std::atomic_load(&model)) {
+        report.add("melody session", activeModel->sessionBytes.load());
+        report.add("melody io", MemoryAccounting::bytesOf(activeModel->batchInput) + MemoryAccounting::bytesOf(activeModel->outputBuffer));
+    }
+    report.add("melody scratch", scratchBytes.load(std::memory_order_relaxed));
+}
 
-                float scale = temperature / 0.8f;
-                for (float& logP : logits) {
-                    logP /= scale;
-                }
+template <typename Spec>
+std::vector<int> BasicMelodyGenerator<Spec>::sampleEvents(const float* outputData, int steps, float temperature) {
+    CT_TRACE_SCOPE("melodySampling");
+    constexpr size_t numClasses = Spec::numClasses;
 
-                std::vector<float> expLogits(numClasses);
-                float sumExp = 0.0f;
-                for (size_t c = 0; c < numClasses; ++c) {
-                    expLogits[c] = expf(logits[c]);
-                    sumExp += expLogits[c];
-                }
+    std::vector<int> generatedEvents;
+    generatedEvents.reserve(steps);
 
-                if (sumExp > 0) {
-                    for (size_t c = 0; c < numClasses; ++c) {
-                        stepProbs[c] = expLogits[c] / sumExp;
-                    }
-                }
-            }
+    // fixed-size rows, nothing in the loop allocates except the distribution
+    std::array<float, numClasses> stepProbs;
+    std::array<float, numClasses> logits;
+    std::array<float, numClasses> expLogits;
 
-            // Sample next event
-            std::discrete_distribution<int> dist(stepProbs.begin(), stepProbs.end());
-            int idx = dist(generator);
-            int event = (idx == 0) ? -1 : (idx == 1) ? -2 : idx - 2;
-            generatedEvents.push_back(event);
+    for (int t = 0; t < steps; ++t) {
+        std::copy_n(outputData + t * numClasses, numClasses, stepProbs.begin());
 
-            if (t < 3) {
-                DBG("Step " + std::to_string(t) + ": event " + std::to_string(event) +
-                    " (idx " + std::to_string(idx) + ")");
+        // Normalize probabilities, the key mask rides along (a multiply by 1 when there's none)
+        float sumProbs = std::accumulate(stepProbs.begin(), stepProbs.end(), 0.0f);
+        if (sumProbs > 0) {
+            for (size_t c = 0; c < numClasses; ++c) {
+                stepProbs[c] = stepProbs[c] / sumProbs * classScale[c];
             }
         }
 
+        // Apply temperature scaling
+        if (temperature != 0.8f) {
+            for (size_t c = 0; c < numClasses; ++c) {
+                logits[c] = logf(std::max(stepProbs[c], 1e-7f));
+            }
 
+            float scale = temperature / 0.8f;
+            for (float& logP : logits) {
+                logP /= scale;
+            }
 
-        return generatedEvents;
+            float sumExp = 0.0f;
+            for (size_t c = 0; c < numClasses; ++c) {
+                expLogits[c] = expf(logits[c]);
+                sumExp += expLogits[c];
+            }
 
-    }
-    catch (const Ort::Exception& e) {
-        DBG("ONNX Runtime error: " + std::string(e.what()));
-        return std::vector<int>();
-    }
-    catch (const std::exception& e) {
-        DBG("Generation error: " + std::string(e.what()));
-        return std::vector<int>();
+            if (sumExp > 0) {
+                for (size_t c = 0; c < numClasses; ++c) {
+                    stepProbs[c] = expLogits[c] / sumExp;
+                }
+            }
+        }
+
+        // Sample next event
+        std::discrete_distribution<int> dist(stepProbs.begin(), stepProbs.end());
+        int idx = dist(generator);
+        int event = Spec::indexToEvent(idx);
+        generatedEvents.push_back(event);
     }
 
-    
-    
-    //    return std::vector<int>();
-}
\ No newline at end of file
+    return generatedEvents;
+}
+
+// every shape the plugin and tools use, a new MelodyModelSpec needs its line here
+template class BasicMelodyGenerator<DefaultMelodySpec>;
+
+// nothing ships these, they're built so a change that only works for the default shape breaks the build
+template class BasicMelodyGenerator<LongPhraseMelodySpec>;
+template class BasicMelodyGenerator<NarrowRangeMelodySpec>;
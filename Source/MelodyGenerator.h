@@ -2,40 +2,144 @@
 #pragma once
 #include <JuceHeader.h>
 #include <onnxruntime_cxx_api.h>
+#include "RealtimeGuard.h"
+#include "MelodyModelSpec.h"
+#include "MemoryAccounting.h"
+#include "HotSwap.h"
 #include <vector>
 #include <random>
 
-class MelodyGenerator {
+// Spec fixes the model shape at compile time, see MelodyModelSpec.h. The instantiations live in
+// MelodyGenerator.cpp, a new shape needs its line there.
+template <typename Spec>
+class BasicMelodyGenerator {
 public:
-	MelodyGenerator();
-	~MelodyGenerator();
+	using ModelSpec = Spec;
 
+	BasicMelodyGenerator();
+	~BasicMelodyGenerator();
+
+	// fails (see getLastError) when the model's shape isn't Spec's
 	bool initialize(const void* modelData, size_t modelDataLength);
 
-	// generate melody from input vector<int>
-	std::vector<int> generateMelody(std::vector<int>& events, float temperature = 0.8f, int steps = 32);
+	// generate melody from input vector<int>, padded or cut to max(steps, Spec::seqLength) first.
+	// longer than one model phrase runs as overlapping windows, see generateWindowed
+	std::vector<int> generateMelody(std::vector<int>& events, float temperature = 0.8f, int steps = Spec::seqLength);
+
+	// load a replacement model on a background thread, validate and warm it up, then swap it in
+	// between two generations. a generation that's already running finishes on the old model.
+	void hotSwapModel(const void* modelData, size_t modelDataLength, std::function<void(bool)> onComplete = nullptr);
 
 	// get last error message if initialization fails
-	std::string getLastError() const { return lastError; }
+	std::string getLastError() const;
+
+	bool isInitialized() const { return std::atomic_load(&model) != nullptr; }
+
+	// run dummy inferences at the real shape so the first real generation runs at steady-state speed,
+	// cut short when the calling thread is asked to exit
+	void warmUp(int iterations = 3);
+	bool isWarmedUp() const { return warmedUp.load(); }
+	double getSteadyStateLatencyMs() const { return steadyStateLatencyMs.load(); }
+
+	// reseed the sampling rng, applied at the start of the next generation so it's safe from any
+	// thread. same seed + same phrases = same counter-melodies
+	void setSeed(uint32_t seed) { pendingSeed.store(static_cast<int64_t>(seed)); }
+
+	// additive log-probability per pitch class (see KeyTracker), folded into every note's class once
+	// here so sampling pays nothing extra for it. note off and hold are never biased.
+	// call from the thread that generates.
+	void setPitchClassBias(const std::array<float, 12>& bias);
+	void clearPitchClassBias() { classScale.fill(1.0f); }
 
-	bool isInitialized() const { return session != nullptr; }
+	// budget mode: sessions run without ORT's CPU arena and the long-form scratch is freed after
+	// every generation instead of kept at its peak. applies to models loaded after the call.
+	// the batch stays at Spec::batchSize, that's part of the model's shape.
+	void setLowMemory(bool enabled) { lowMemory.store(enabled); }
+
+	// adds the loaded model and the generator's buffers, safe from any thread
+	void addMemoryUsage(MemoryAccounting::Report& report) const;
 
 private:
+	// session plus everything tied to it, swapped as one unit
+	struct Model {
+		std::unique_ptr<Ort::Session> session;
+
+		// looked up once in initialize instead of on every run
+		std::string inputName;
+		std::string outputName;
+
+		// preallocated model io, output is only bound when the model's output shape is fully static
+		std::vector<float> batchInput;
+		std::vector<float> outputBuffer;
+		std::vector<int64_t> outputShape;
+		std::vector<Ort::Value> dynamicOutputs;
+
+		std::atomic<size_t> sessionBytes{ 0 };  // resident set growth while loading and warming up
+	};
+
 	// onnx runtime env & session
 	Ort::Env env;
-	std::unique_ptr<Ort::Session> session;
+	std::shared_ptr<Model> model; // only through std::atomic_load/atomic_store
 	Ort::AllocatorWithDefaultOptions allocator;
 	Ort::MemoryInfo memoryInfo;
 
+	std::atomic<bool> warmedUp{ false };
+	std::atomic<double> steadyStateLatencyMs{ 0.0 };
+	bool firstRunLogged = false;
+
 	// random number generator for sampling (? why do I need this ?)
 	std::mt19937 generator;
+	std::atomic<int64_t> pendingSeed{ -1 };
+
+	// exp of the pitch class bias per model class, all ones when unconstrained
+	std::array<float, Spec::numClasses> classScale;
 
-	// error tracking
+	// error tracking, written by the loader thread too
 	std::string lastError;
+	RealtimeGuard::CheckedCriticalSection errorLock;
+	void setLastError(const std::string& error);
 
 	// helper functions
-	std::vector<float> eventsToOnehot(const std::vector<int>& events);
-	std::vector<float> createBatchInput(const std::vector<float>& onehot, int batchSize = 128);
+	// writes one [seqLength, numClasses] row, events past seqLength are ignored
+	void eventsToOnehot(const int* events, int numEvents, float* row);
+	// the phrase in every row of batch
+	void createBatchInput(const std::vector<int>& events, std::vector<float>& batch);
+
+	// step 7, draws one event per step from the model's [seqLength, numClasses] output
+	std::vector<int> sampleEvents(const float* outputProbs, int steps, float temperature);
+
+	// creates a session and runs the shape checks, nullptr + lastError if it doesn't fit
+	std::shared_ptr<Model> createModel(const void* modelData, size_t modelDataLength);
+
+	// runs batchInput through the session, returns the [rows, seqLength, numClasses] output
+	const float* runModel(Model& m, int rows = 1);
+
+	// Long-form generation. Windows of seqLength every windowHop steps (the last one flush with the
+	// end) each take a row of the batch, so up to batchSize windows cost one Run. Where windows
+	// overlap their outputs are cross-faded with a triangular weight, always in window order, and
+	// the stitched [length, numClasses] probabilities go through the usual sampler.
+	static constexpr int windowHop = Spec::seqLength / 2 > 0 ? Spec::seqLength / 2 : 1;
+	const float* generateWindowed(Model& m, const std::vector<int>& events);
+	std::vector<float> windowProbs;   // stitched output, grows to the longest line asked for
+	std::vector<float> windowWeights;  // summed cross-fade weight per step
+
+	std::atomic<bool> lowMemory{ false };
+	std::atomic<size_t> scratchBytes{ 0 };  // window buffers, published after every generation
+	void releaseScratch();
+
+	double warmUpModel(Model& m, int iterations);
+
+	// a swapped-out model waits here for the generation thread, which drops it at the start of its
+	// next run when it can't be holding it any more
+	std::shared_ptr<Model> retiredModel; // only through std::atomic_load/atomic_exchange
+	void retireModel(std::shared_ptr<Model> oldModel);
+	std::atomic<bool> shuttingDown{ false };
+
+	// Benchmarks/ times the helpers above directly
+	friend struct BenchmarkAccess;
+
+	// runs hot swaps, declared last so a pending swap finishes before anything else goes away
+	juce::ThreadPool loaderPool{ 1 };
+};
 
-	std::string eventsToString(const std::vector<int>& events); // for debugging
-};
\ No newline at end of file
+using MelodyGenerator = BasicMelodyGenerator<DefaultMelodySpec>;
\ No newline at end of file
@@ -0,0 +1,59 @@
+// MelodyModelSpec.h
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of a melody model as compile-time constants. The generator is templated on it, so the
+// encode, batch and sampling loops all have fixed trip counts the compiler can unroll and
+// vectorise, and a model of another shape is another instantiation instead of a runtime branch.
+//
+// Events: -1 = note off, -2 = hold, 0-127 = note. Model classes: 0 = note off, 1 = hold, n + 2 = note n.
+template <int SeqLength, int NumClasses, int BatchSize>
+struct MelodyModelSpec {
+	static_assert(SeqLength > 0 && NumClasses > 2 && BatchSize > 0, "invalid melody model shape");
+
+	static constexpr int seqLength = SeqLength;
+	static constexpr int numClasses = NumClasses;
+	static constexpr int batchSize = BatchSize;
+
+	static constexpr size_t phraseSize = static_cast<size_t>(SeqLength) * NumClasses;  // one onehot row
+	static constexpr size_t inputSize = phraseSize * BatchSize;
+
+	static constexpr int noteOff = -1;
+	static constexpr int hold = -2;
+
+	static constexpr int eventToIndex(int event) { return event == noteOff ? 0 : event == hold ? 1 : event + 2; }
+	static constexpr int indexToEvent(int index) { return index == 0 ? noteOff : index == 1 ? hold : index - 2; }
+
+	static constexpr std::array<int64_t, 3> inputShape() { return { BatchSize, SeqLength, NumClasses }; }
+
+	// the model's input has to be exactly [batch, seq, classes]
+	static bool matchesInput(const std::vector<int64_t>& shape) {
+		return shape.size() == 3 && shape[0] == BatchSize && shape[1] == SeqLength && shape[2] == NumClasses;
+	}
+
+	// output is read as [batch, seq, classes] too, dynamic (-1) dimensions are only known after a run
+	static bool matchesOutput(const std::vector<int64_t>& shape) {
+		if (shape.size() != 3) return false;
+		const int64_t expected[] = { BatchSize, SeqLength, NumClasses };
+		for (size_t i = 0; i < 3; ++i)
+			if (shape[i] > 0 && shape[i] != expected[i])
+				return false;
+		return true;
+	}
+
+	static std::string describe() {
+		return "[" + std::to_string(BatchSize) + ", " + std::to_string(SeqLength) + ", " + std::to_string(NumClasses) + "]";
+	}
+};
+
+// the shipped model, 32 sixteenths over 128 notes + note off + hold, batch of 128
+using DefaultMelodySpec = MelodyModelSpec<32, 130, 128>;
+
+// two-bar phrases, same vocabulary
+using LongPhraseMelodySpec = MelodyModelSpec<64, 130, 128>;
+
+// notes 0-87 only + note off + hold, events outside it are dropped by the encoder
+using NarrowRangeMelodySpec = MelodyModelSpec<32, 90, 128>;
@@ -0,0 +1,67 @@
+#include "MemoryAccounting.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <psapi.h>
+#elif JUCE_MAC
+ #include <mach/mach.h>
+#elif JUCE_LINUX
+ #include <unistd.h>
+ #include <cstdio>
+#endif
+
+namespace MemoryAccounting {
+
+    size_t Report::getInstanceBytes() const {
+        size_t total = 0;
+        for (const auto& entry : entries)
+            if (!entry.shared) total += entry.bytes;
+        return total;
+    }
+
+    size_t Report::getSharedBytes() const {
+        size_t total = 0;
+        for (const auto& entry : entries)
+            if (entry.shared) total += entry.bytes;
+        return total;
+    }
+
+    juce::String Report::toString() const {
+        juce::String text;
+        for (const auto& entry : entries)
+            text << entry.name << ": " << formatBytes(entry.bytes) << (entry.shared ? " (shared)" : "") << "\n";
+        text << "instance: " << formatBytes(getInstanceBytes()) << ", shared: " << formatBytes(getSharedBytes());
+        return text;
+    }
+
+    size_t getProcessResidentBytes() {
+#if JUCE_WINDOWS
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return static_cast<size_t>(counters.WorkingSetSize);
+        return 0;
+#elif JUCE_MAC
+        mach_task_basic_info info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+            return static_cast<size_t>(info.resident_size);
+        return 0;
+#elif JUCE_LINUX
+        // second field of statm is the resident page count
+        long size = 0, pages = 0;
+        if (auto* file = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(file, "%ld %ld", &size, &pages) != 2)
+                pages = 0;
+            std::fclose(file);
+        }
+        return static_cast<size_t>(pages) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+        return 0;
+#endif
+    }
+
+    size_t ScopedLoadMeasurement::getGrowth() const {
+        const size_t now = getProcessResidentBytes();
+        return now > residentBefore ? now - residentBefore : 0;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+
+// What an instance holds on to, component by component. Buffers we allocate ourselves are counted
+// exactly. ONNX Runtime doesn't expose what its sessions and arenas keep, so those are measured as
+// the growth of the resident set while a session loads and warms up, which is when the arena
+// reaches the size it keeps. That's best effort: instances load in parallel, and one that loads
+// alongside another can count some of the other's growth as well.
+namespace MemoryAccounting {
+
+    struct Entry {
+        juce::String name;
+        size_t bytes = 0;
+        bool shared = false;  // in the plugin binary, paid once per process and not per instance
+    };
+
+    class Report {
+    public:
+        void add(const juce::String& name, size_t bytes, bool shared = false) { entries.push_back({ name, bytes, shared }); }
+
+        const std::vector<Entry>& getEntries() const { return entries; }
+        size_t getInstanceBytes() const;
+        size_t getSharedBytes() const;
+
+        // one line per entry plus the totals
+        juce::String toString() const;
+
+    private:
+        std::vector<Entry> entries;
+    };
+
+    // resident set of the whole process, 0 where the platform won't say
+    size_t getProcessResidentBytes();
+
+    // getGrowth is how much the resident set grew since construction
+    class ScopedLoadMeasurement {
+    public:
+        ScopedLoadMeasurement() : residentBefore(getProcessResidentBytes()) {}
+        size_t getGrowth() const;
+
+    private:
+        size_t residentBefore;
+    };
+
+    template <typename T>
+    size_t bytesOf(const std::vector<T>& vector) { return vector.capacity() * sizeof(T); }
+
+    inline juce::String formatBytes(size_t bytes) { return juce::String(static_cast<double>(bytes) / (1024.0 * 1024.0), 1) + " MB"; }
+}
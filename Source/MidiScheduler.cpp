@@ -0,0 +1,29 @@
+#include "MidiScheduler.h"
+
+void MidiScheduler::loadPhrase(const int* events, int length) {
+    scheduleLength = juce::jlimit(0, maxPhraseLength, length);
+    std::copy(events, events + scheduleLength, schedule.begin());
+}
+
+void MidiScheduler::renderSlot(int phrasePosition, int sampleOffset, juce::MidiBuffer& midiMessages) {
+    if (!juce::isPositiveAndBelow(phrasePosition, scheduleLength)) return;
+
+    const int event = schedule[static_cast<size_t>(phrasePosition)];
+
+    if (event == -2) return; // hold, whatever is sounding keeps sounding
+
+    // note off, or a new note that replaces the sounding one
+    stopSounding(sampleOffset, midiMessages);
+
+    if (juce::isPositiveAndBelow(event, 128)) {
+        midiMessages.addEvent(juce::MidiMessage::noteOn(channel, event, velocity), sampleOffset);
+        soundingNote = event;
+    }
+}
+
+void MidiScheduler::stopSounding(int sampleOffset, juce::MidiBuffer& midiMessages) {
+    if (soundingNote < 0) return;
+
+    midiMessages.addEvent(juce::MidiMessage::noteOff(channel, soundingNote), sampleOffset);
+    soundingNote = -1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+// Turns the generated counter-melody into MIDI on the audio thread. The phrase is copied into a
+// preallocated schedule at each phrase start and every sixteenth boundary renders its event at
+// the exact sample offset the phrase clock reported. The sounding note is tracked independently
+// of the phrase, so swapping phrases or stopping the transport never leaves a note hanging.
+class MidiScheduler {
+public:
+    static constexpr int maxPhraseLength = 256;
+
+    void setChannel(int newChannel) { channel = newChannel; }
+    void setVelocity(float newVelocity) { velocity = newVelocity; }
+
+    // Replaces the schedule, takes effect from the next rendered slot
+    void loadPhrase(const int* events, int length);
+
+    // Renders the event scheduled for this phrase position
+    void renderSlot(int phrasePosition, int sampleOffset, juce::MidiBuffer& midiMessages);
+
+    // Ends the sounding note, e.g. on transport stop or relocation
+    void stopSounding(int sampleOffset, juce::MidiBuffer& midiMessages);
+
+    int getSoundingNote() const { return soundingNote; }
+
+private:
+    std::array<int, maxPhraseLength> schedule{};
+    int scheduleLength = 0;
+    int soundingNote = -1;
+    int channel = 1;
+    float velocity = 0.8f;
+};
@@ -0,0 +1,42 @@
+#include "OnsetDetector.h"
+
+void OnsetDetector::prepare(double sampleRate) {
+    refractorySamples = static_cast<juce::int64>(refractorySeconds * sampleRate);
+    reset();
+}
+
+void OnsetDetector::reset() {
+    previousSample = 0.0f;
+    hopEnergy = 0.0f;
+    hopFill = 0;
+    average = 0.0f;
+    lastOnset = -(juce::int64(1) << 40);
+}
+
+int OnsetDetector::process(const float* samples, int numSamples, juce::int64 firstSample, juce::int64* onsets, int maxOnsets) {
+    int numOnsets = 0;
+
+    for (int i = 0; i < numSamples; ++i) {
+        const float difference = samples[i] - previousSample;
+        previousSample = samples[i];
+        hopEnergy += difference * difference;
+
+        if (++hopFill < hopSize)
+            continue;
+
+        const float hfc = hopEnergy / static_cast<float>(hopSize);
+        const juce::int64 hopStart = firstSample + i + 1 - hopSize;
+
+        if (hfc > silenceFloor && hfc > threshold * average && hopStart - lastOnset >= refractorySamples) {
+            lastOnset = hopStart;
+            if (numOnsets < maxOnsets)
+                onsets[numOnsets++] = hopStart;
+        }
+
+        average = averageCoefficient * average + (1.0f - averageCoefficient) * hfc;
+        hopEnergy = 0.0f;
+        hopFill = 0;
+    }
+
+    return numOnsets;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Streaming note onset detector for the pitch path. Every hop of 128 samples gets a high
+// frequency content value, the energy of the first difference (a spectrum weighted towards the
+// top, without an FFT). An onset is a hop that jumps well above the running average of the ones
+// before it. Costs a subtract and a multiply-add per sample.
+class OnsetDetector {
+public:
+    static constexpr int hopSize = 128;
+
+    void prepare(double sampleRate);
+    void reset();
+
+    // samples continue the timeline at firstSample. writes the first sample of every onset hop to
+    // onsets, up to maxOnsets, and returns how many
+    int process(const float* samples, int numSamples, juce::int64 firstSample, juce::int64* onsets, int maxOnsets);
+
+private:
+    static constexpr float threshold = 4.0f;             // times the running average
+    static constexpr float silenceFloor = 1.0e-6f;       // mean HFC per sample, quieter is never an onset
+    static constexpr float averageCoefficient = 0.9f;    // per hop
+    static constexpr double refractorySeconds = 0.05;
+
+    float previousSample = 0.0f;
+    float hopEnergy = 0.0f;
+    int hopFill = 0;
+    float average = 0.0f;
+    juce::int64 lastOnset = -(juce::int64(1) << 40);
+    juce::int64 refractorySamples = 2205;
+};
@@ -0,0 +1,60 @@
+#include "PerformanceMetrics.h"
+
+void PerformanceMetrics::recordBlock(double seconds, double budgetSeconds) noexcept {
+    blockDuration.record(seconds);
+    blockCount.store(blockCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (budgetSeconds <= 0.0) return;
+
+    const auto load = static_cast<float>(seconds / budgetSeconds);
+    if (load > 1.0f)
+        missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+
+    // only the audio thread writes these two, no need for read-modify-write
+    const auto smoothed = dspLoad.load(std::memory_order_relaxed);
+    dspLoad.store(smoothed + loadSmoothing * (load - smoothed), std::memory_order_relaxed);
+    if (load > peakDspLoad.load(std::memory_order_relaxed))
+        peakDspLoad.store(load, std::memory_order_relaxed);
+}
+
+void PerformanceMetrics::addDroppedSamples(int numSamples) noexcept {
+    if (numSamples > 0)
+        droppedSamples.fetch_add(static_cast<juce::uint64>(numSamples), std::memory_order_relaxed);
+}
+
+void PerformanceMetrics::reset() noexcept {
+    blockDuration.reset();
+    pitchInference.reset();
+    pitchLatency.reset();
+    generationLatency.reset();
+    dspLoad.store(0.0f);
+    peakDspLoad.store(0.0f);
+    missedDeadlines.store(0);
+    droppedSamples.store(0);
+}
+
+std::unique_ptr<juce::XmlElement> PerformanceMetrics::createXml() const {
+    auto xml = std::make_unique<juce::XmlElement>("PerformanceMetrics");
+    xml->setAttribute("dspLoad", static_cast<double>(getDspLoad()));
+    xml->setAttribute("peakDspLoad", static_cast<double>(getPeakDspLoad()));
+    xml->setAttribute("missedDeadlines", juce::String(getMissedDeadlines()));
+    xml->setAttribute("droppedSamples", juce::String(getDroppedSamples()));
+
+    const std::pair<const char*, const LatencyHistogram*> histograms[] = {
+        { "blockDuration", &blockDuration },
+        { "pitchInference", &pitchInference },
+        { "pitchLatency", &pitchLatency },
+        { "generationLatency", &generationLatency }
+    };
+
+    for (const auto& [name, histogram] : histograms) {
+        const auto summary = histogram->getSummary();
+        auto* child = xml->createNewChildElement(name);
+        child->setAttribute("count", juce::String(summary.count));
+        child->setAttribute("p50Ms", summary.p50Ms);
+        child->setAttribute("p99Ms", summary.p99Ms);
+        child->setAttribute("maxMs", summary.maxMs);
+    }
+
+    return xml;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <JuceHeader.h>
+#include "LatencyHistogram.h"
+
+// Everything the plugin measures about itself, written by the audio, pitch and generation threads
+// and read by the editor and the tools. All lock-free.
+//
+//   blockDuration      processBlock wall time, its budget is the audio the block holds
+//   pitchInference     one CREPE run (or DSP estimate) on the pitch thread
+//   pitchLatency       from the newest sample of a frame reaching processBlock to its pitch being known
+//   generationLatency  from the audio thread asking for a counter-melody to it being published
+class PerformanceMetrics {
+public:
+    LatencyHistogram blockDuration;
+    LatencyHistogram pitchInference;
+    LatencyHistogram pitchLatency;
+    LatencyHistogram generationLatency;
+
+    // Audio thread
+    void recordBlock(double seconds, double budgetSeconds) noexcept;
+    void addDroppedSamples(int numSamples) noexcept;
+
+    float getDspLoad() const noexcept { return dspLoad.load(std::memory_order_relaxed); }
+    float getPeakDspLoad() const noexcept { return peakDspLoad.load(std::memory_order_relaxed); }
+    juce::uint64 getMissedDeadlines() const noexcept { return missedDeadlines.load(std::memory_order_relaxed); }
+    juce::uint64 getDroppedSamples() const noexcept { return droppedSamples.load(std::memory_order_relaxed); }
+    // bumps with every recorded block, what the editor refreshes the numbers on
+    juce::uint64 getBlockCount() const noexcept { return blockCount.load(std::memory_order_relaxed); }
+
+    void reset() noexcept;
+
+    // counters plus p50/p99/max per histogram. getStateInformation appends it after the state,
+    // hosts and tools can call it directly
+    std::unique_ptr<juce::XmlElement> createXml() const;
+
+    // Times the enclosing processBlock
+    class ScopedBlockTimer {
+    public:
+        ScopedBlockTimer(PerformanceMetrics& m, int numSamples, double sampleRate) noexcept
+            : metrics(m),
+              budgetSeconds(sampleRate > 0.0 ? numSamples / sampleRate : 0.0),
+              startTicks(juce::Time::getHighResolutionTicks()) {}
+
+        ~ScopedBlockTimer() noexcept {
+            metrics.recordBlock(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks), budgetSeconds);
+        }
+
+    private:
+        PerformanceMetrics& metrics;
+        double budgetSeconds;
+        juce::int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedBlockTimer)
+    };
+
+private:
+    static constexpr float loadSmoothing = 0.05f;
+
+    std::atomic<float> dspLoad{ 0.0f };      // smoothed duration / budget
+    std::atomic<float> peakDspLoad{ 0.0f };
+    std::atomic<juce::uint64> missedDeadlines{ 0 };
+    std::atomic<juce::uint64> droppedSamples{ 0 };
+    std::atomic<juce::uint64> blockCount{ 0 };
+};
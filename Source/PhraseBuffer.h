@@ -0,0 +1,82 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+// Lock-free double buffer for handing a phrase (-1 = note off, -2 = hold, 0-127 = note) from one
+// writer thread to any number of readers, the audio thread included. The writer fills the slot
+// readers aren't pointed at and then publishes it; neither side ever waits on the other.
+//
+// The version counter is a seqlock: odd while a write is in progress, and the published slot for
+// an even version V is (V / 2) & 1. A reader only has to retry if the writer went on to rewrite
+// the slot it was copying, i.e. two publishes landed during one read.
+template <int MaxLength>
+class PhraseBuffer {
+public:
+    static constexpr int maxLength = MaxLength;
+
+    PhraseBuffer(int initialLength, int fillEvent) {
+        for (auto& slot : slots) {
+            for (auto& event : slot.events)
+                event.store(fillEvent, std::memory_order_relaxed);
+            slot.length.store(clampLength(initialLength), std::memory_order_relaxed);
+        }
+    }
+
+    // Single writer only
+    void publish(const int* events, int length) {
+        const auto current = version.load(std::memory_order_relaxed);
+        version.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto& slot = slots[((current / 2) + 1) & 1];
+        length = clampLength(length);
+        for (int i = 0; i < length; ++i)
+            slot.events[static_cast<size_t>(i)].store(events[i], std::memory_order_relaxed);
+        slot.length.store(length, std::memory_order_relaxed);
+
+        version.store(current + 2, std::memory_order_release);
+    }
+
+    void publish(const std::vector<int>& events) { publish(events.data(), static_cast<int>(events.size())); }
+
+    // Copies the latest phrase into dest, returns its length. Doesn't allocate.
+    int read(int* dest, int destCapacity) const {
+        for (;;) {
+            const auto before = version.load(std::memory_order_acquire) & ~1u;
+            const auto& slot = slots[(before / 2) & 1];
+
+            const int length = std::min(slot.length.load(std::memory_order_relaxed), destCapacity);
+            for (int i = 0; i < length; ++i)
+                dest[i] = slot.events[static_cast<size_t>(i)].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // the slot only gets rewritten by the publish after next
+            if (version.load(std::memory_order_relaxed) <= before + 2)
+                return length;
+        }
+    }
+
+    std::vector<int> snapshot() const {
+        std::vector<int> events(static_cast<size_t>(maxLength));
+        events.resize(static_cast<size_t>(read(events.data(), maxLength)));
+        return events;
+    }
+
+    // Bumps once per publish, cheap way for readers to see whether anything changed
+    uint32_t getVersion() const { return version.load(std::memory_order_acquire) / 2; }
+
+private:
+    struct Slot {
+        std::array<std::atomic<int>, MaxLength> events;
+        std::atomic<int> length{ 0 };
+    };
+
+    std::array<Slot, 2> slots;
+    std::atomic<uint32_t> version{ 0 };
+
+    static int clampLength(int length) { return length < 0 ? 0 : (length > MaxLength ? MaxLength : length); }
+};
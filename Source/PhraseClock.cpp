@@ -0,0 +1,96 @@
+#include "PhraseClock.h"
+
+void PhraseClock::prepare(double newSampleRate) {
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    freeRunningPpq = 0.0;
+    expectedPpq = -1.0;
+    playing = false;
+    hostDriven = false;
+    jumped = false;
+    stopped = false;
+    samplePosition = 0;
+    blockStartSample = 0;
+    numSlotEvents = 0;
+}
+
+void PhraseClock::advance(juce::AudioPlayHead* playHead, int numSamples) {
+    numSlotEvents = 0;
+    jumped = false;
+    stopped = false;
+    blockStartSample = samplePosition;
+    samplePosition += numSamples;
+
+    const bool wasPlaying = playing;
+
+    juce::Optional<juce::AudioPlayHead::PositionInfo> position;
+    if (playHead != nullptr)
+        position = playHead->getPosition();
+
+    hostDriven = position.hasValue() && position->getPpqPosition().hasValue();
+
+    const auto hostBpm = position.hasValue() ? position->getBpm() : juce::Optional<double>();
+    currentBpm = hostBpm.hasValue() && *hostBpm > 0.0 ? *hostBpm : fallbackBpm;
+
+    const double samplesPerBeat = sampleRate * 60.0 / currentBpm;
+    const double blockBeats = numSamples / samplesPerBeat;
+
+    if (!hostDriven) {
+        // No transport to follow, keep time ourselves
+        playing = true;
+        jumped = !wasPlaying;
+        addSlots(freeRunningPpq, freeRunningPpq + blockBeats, samplesPerBeat, 0.0, numSamples);
+        freeRunningPpq += blockBeats;
+        return;
+    }
+
+    playing = position->getIsPlaying();
+    stopped = wasPlaying && !playing;
+
+    if (!playing) {
+        expectedPpq = -1.0;
+        return;
+    }
+
+    const double ppqStart = *position->getPpqPosition();
+    const double ppqEnd = ppqStart + blockBeats;
+
+    // Anything but a continuation of the previous block is a start, relocation or loop wrap.
+    // The tolerance covers hosts rounding PPQ, it's well under a sixteenth.
+    jumped = !wasPlaying || expectedPpq < 0.0 || std::abs(ppqStart - expectedPpq) > 1.0e-2;
+
+    // A loop that wraps inside this block: count up to the loop end, then carry on from the loop start
+    if (position->getIsLooping()) {
+        if (const auto loop = position->getLoopPoints()) {
+            if (loop->ppqEnd > loop->ppqStart && ppqStart < loop->ppqEnd && ppqEnd > loop->ppqEnd) {
+                const double beatsBeforeWrap = loop->ppqEnd - ppqStart;
+                const double beatsAfterWrap = blockBeats - beatsBeforeWrap;
+
+                addSlots(ppqStart, loop->ppqEnd, samplesPerBeat, 0.0, numSamples);
+                addSlots(loop->ppqStart, loop->ppqStart + beatsAfterWrap, samplesPerBeat,
+                         beatsBeforeWrap * samplesPerBeat, numSamples);
+
+                expectedPpq = loop->ppqStart + beatsAfterWrap;
+                jumped = true;
+                return;
+            }
+        }
+    }
+
+    addSlots(ppqStart, ppqEnd, samplesPerBeat, 0.0, numSamples);
+    expectedPpq = ppqEnd;
+}
+
+void PhraseClock::addSlots(double ppqStart, double ppqEnd, double samplesPerBeat, double firstSample, int numSamples) {
+    const double beatsPerSlot = 1.0 / slotsPerBeat;
+
+    // First boundary at or after ppqStart
+    auto slot = static_cast<juce::int64>(std::ceil(ppqStart * slotsPerBeat - 1.0e-9));
+
+    for (; slot * beatsPerSlot < ppqEnd && numSlotEvents < maxSlotsPerBlock; ++slot) {
+        // First whole sample at or after the boundary
+        const double offset = firstSample + (slot * beatsPerSlot - ppqStart) * samplesPerBeat;
+        const int sampleOffset = juce::jlimit(0, numSamples - 1, static_cast<int>(std::ceil(offset - 1.0e-6)));
+
+        slotEvents[static_cast<size_t>(numSlotEvents++)] = { sampleOffset, slot };
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+// Sample-accurate sixteenth-note clock. Every block it reads tempo, PPQ position and transport
+// state from the host play head and works out exactly where inside the block each sixteenth
+// boundary falls, so capture and MIDI timing don't depend on the buffer size. Without host
+// transport info it free-runs at the fallback tempo.
+class PhraseClock {
+public:
+    static constexpr int slotsPerBeat = 4;       // sixteenth notes
+    static constexpr int maxSlotsPerBlock = 64;  // plenty for any sane tempo and block size
+
+    struct SlotEvent {
+        int sampleOffset;       // position inside the current block
+        juce::int64 slotIndex;  // sixteenths since PPQ 0, phrase position is slotIndex % phraseLength
+    };
+
+    // Position of a slot inside a phrase, also for the negative slots of a host pre-roll
+    static int getPhrasePosition(juce::int64 slotIndex, int phraseLength) {
+        const auto position = static_cast<int>(slotIndex % phraseLength);
+        return position < 0 ? position + phraseLength : position;
+    }
+
+    void prepare(double sampleRate);
+    void setFallbackTempo(double bpm) { fallbackBpm = bpm; }
+
+    // Call once per block before anything that needs slot timing
+    void advance(juce::AudioPlayHead* playHead, int numSamples);
+
+    int getNumSlotEvents() const { return numSlotEvents; }
+    const SlotEvent& getSlotEvent(int index) const { return slotEvents[static_cast<size_t>(index)]; }
+
+    double getBpm() const { return currentBpm; }
+    double getSamplesPerSlot() const { return sampleRate * 60.0 / currentBpm / slotsPerBeat; }
+    bool isPlaying() const { return playing; }
+    bool isHostDriven() const { return hostDriven; }
+
+    // True for the block in which playback started, the host relocated or a loop wrapped
+    bool didJump() const { return jumped; }
+    bool didStop() const { return stopped; }
+
+    // Samples processed since prepare, a timeline that keeps counting regardless of the host
+    juce::int64 getSamplePosition() const { return samplePosition; }
+    juce::int64 getBlockStartSample() const { return blockStartSample; }
+
+private:
+    double sampleRate = 44100.0;
+    double fallbackBpm = 140.0;
+    double currentBpm = 140.0;
+
+    double freeRunningPpq = 0.0;
+    double expectedPpq = -1.0;  // where the host should be at the start of the next block
+    bool playing = false;
+    bool hostDriven = false;
+    bool jumped = false;
+    bool stopped = false;
+
+    juce::int64 samplePosition = 0;
+    juce::int64 blockStartSample = 0;
+
+    std::array<SlotEvent, maxSlotsPerBlock> slotEvents{};
+    int numSlotEvents = 0;
+
+    // Adds the boundaries in [ppqStart, ppqEnd), with sample offsets relative to firstSample
+    void addSlots(double ppqStart, double ppqEnd, double samplesPerBeat, double firstSample, int numSamples);
+};
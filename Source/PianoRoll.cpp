@@ -0,0 +1,92 @@
+#include "PianoRoll.h"
+
+PianoRoll::PianoRoll(juce::Colour noteColour) : colour(noteColour) {
+    sounding.fill(-1);
+    setOpaque(true);
+}
+
+void PianoRoll::setPhrase(const int* events, int length) {
+    length = juce::jlimit(0, maxSlots, length);
+    if (length != numSlots) {
+        numSlots = length;
+        renderBackground();
+        repaint();
+    }
+
+    int note = -1;
+    for (int slot = 0; slot < length; ++slot) {
+        const int event = events[slot];
+        if (event >= 0) note = event;
+        else if (event == -1) note = -1;
+
+        const bool starts = event >= 0;
+        if (sounding[static_cast<size_t>(slot)] != note || onset[static_cast<size_t>(slot)] != starts) {
+            sounding[static_cast<size_t>(slot)] = note;
+            onset[static_cast<size_t>(slot)] = starts;
+            repaint(getSlotBounds(slot));
+        }
+    }
+}
+
+juce::Rectangle<int> PianoRoll::getSlotBounds(int slot) const {
+    const float slotWidth = static_cast<float>(getWidth()) / static_cast<float>(juce::jmax(1, numSlots));
+    const int left = juce::roundToInt(slot * slotWidth);
+    const int right = juce::roundToInt((slot + 1) * slotWidth);
+    return { left, 0, right - left, getHeight() };
+}
+
+void PianoRoll::resized() {
+    renderBackground();
+}
+
+void PianoRoll::renderBackground() {
+    if (getWidth() <= 0 || getHeight() <= 0) return;
+
+    background = juce::Image(juce::Image::RGB, getWidth(), getHeight(), true);
+    juce::Graphics g(background);
+    g.fillAll(juce::Colours::black);
+
+    // black key rows a shade lighter, a line under every C
+    const float rowHeight = static_cast<float>(getHeight()) / static_cast<float>(highestNote - lowestNote + 1);
+    for (int note = lowestNote; note <= highestNote; ++note) {
+        const float y = (highestNote - note) * rowHeight;
+        const int pitchClass = note % 12;
+        if (pitchClass == 1 || pitchClass == 3 || pitchClass == 6 || pitchClass == 8 || pitchClass == 10) {
+            g.setColour(juce::Colour::fromRGB(20, 20, 20));
+            g.fillRect(0.0f, y, static_cast<float>(getWidth()), rowHeight);
+        }
+        if (pitchClass == 0) {
+            g.setColour(juce::Colour::fromRGB(60, 60, 60));
+            g.drawHorizontalLine(juce::roundToInt(y + rowHeight) - 1, 0.0f, static_cast<float>(getWidth()));
+        }
+    }
+
+    // beats, brighter on the bar
+    for (int slot = 4; slot < numSlots; slot += 4) {
+        g.setColour(slot % 16 == 0 ? juce::Colour::fromRGB(90, 90, 90) : juce::Colour::fromRGB(40, 40, 40));
+        g.drawVerticalLine(getSlotBounds(slot).getX(), 0.0f, static_cast<float>(getHeight()));
+    }
+}
+
+void PianoRoll::paint(juce::Graphics& g) {
+    g.drawImageAt(background, 0, 0);
+
+    // only the columns inside the clip, usually the few that changed
+    const auto clip = g.getClipBounds();
+    const float slotWidth = static_cast<float>(getWidth()) / static_cast<float>(juce::jmax(1, numSlots));
+    const int firstSlot = juce::jmax(0, static_cast<int>(clip.getX() / slotWidth) - 1);
+    const int lastSlot = juce::jmin(numSlots - 1, static_cast<int>(clip.getRight() / slotWidth) + 1);
+
+    const float rowHeight = static_cast<float>(getHeight()) / static_cast<float>(highestNote - lowestNote + 1);
+    g.setColour(colour);
+    for (int slot = firstSlot; slot <= lastSlot; ++slot) {
+        const int note = sounding[static_cast<size_t>(slot)];
+        if (note < 0) continue;
+
+        // a one pixel gap in front of every onset keeps repeated notes apart
+        const auto bounds = getSlotBounds(slot);
+        const int gap = onset[static_cast<size_t>(slot)] ? 1 : 0;
+        const float y = (highestNote - juce::jlimit(lowestNote, highestNote, note)) * rowHeight;
+        g.fillRect(static_cast<float>(bounds.getX() + gap), y, static_cast<float>(bounds.getWidth() - gap), rowHeight);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+// One phrase as a piano roll, a slot per column. The grid is drawn once into an image whenever the
+// size changes, and a new phrase only repaints the columns whose picture actually changed, so an
+// editor can push phrases at it as often as it likes.
+class PianoRoll : public juce::Component {
+public:
+    static constexpr int maxSlots = 64;
+
+    explicit PianoRoll(juce::Colour noteColour);
+
+    // -1 = note off, -2 = hold, 0-127 = note, message thread only
+    void setPhrase(const int* events, int length);
+
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+
+private:
+    static constexpr int lowestNote = 36;   // C2, anything outside sits on the edge row
+    static constexpr int highestNote = 95;  // B6
+
+    juce::Colour colour;
+    juce::Image background;
+
+    int numSlots = 32;
+    std::array<int, maxSlots> sounding;  // note playing in each slot, -1 = silence
+    std::array<bool, maxSlots> onset{};  // slot starts the note
+
+    juce::Rectangle<int> getSlotBounds(int slot) const;
+    void renderBackground();
+};
@@ -1,108 +1,587 @@
 #include "PitchDetector.h"
+#include "Trace.h"
 
 PitchDetector::PitchDetector()
     : env(ORT_LOGGING_LEVEL_WARNING, "PitchDetector"),
     memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault))
 {
-
+    // only becomes available once initializeTinyModel succeeds
+    qualityController.setTierAvailable(QualityController::Tier::tinyModel, false);
 }
 
-PitchDetector::~PitchDetector() {}
+PitchDetector::~PitchDetector() {
+    // a swap still loading doesn't publish into a detector that's going away, queued ones are
+    // dropped and report failure through their completion
+    shuttingDown.store(true);
+    loaderPool.removeAllJobs(false, -1);
+}
 
 bool PitchDetector::initialize(const void* modelData, size_t modelDataLength) {
+    auto model = createSession(modelData, modelDataLength);
+    if (!model) return false;
+
+    std::atomic_store(&session, model);
+
+    DBG("CREPE model initialized successfully");
+    return true;
+}
+
+bool PitchDetector::initializeTinyModel(const void* modelData, size_t modelDataLength) {
+    auto model = createSession(modelData, modelDataLength);
+    qualityController.setTierAvailable(QualityController::Tier::tinyModel, model != nullptr);
+    if (!model) return false;
+
+    std::atomic_store(&tinySession, model);
+
+    DBG("CREPE tiny model initialized successfully");
+    return true;
+}
+
+void PitchDetector::releaseTinyModel() {
+    qualityController.setTierAvailable(QualityController::Tier::tinyModel, false);
+    // a frame that already picked it up finishes on it, the pitch thread lets go of it after that
+    retireModel(std::atomic_exchange(&tinySession, std::shared_ptr<CrepeModel>()));
+}
+
+std::shared_ptr<PitchDetector::CrepeModel> PitchDetector::createSession(const void* modelData, size_t modelDataLength) {
     try {
         Ort::SessionOptions sessionOptions;
         sessionOptions.SetIntraOpNumThreads(1);
         sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_BASIC);
+        if (lowMemory.load())
+            sessionOptions.DisableCpuMemArena();
 
         // Load the model directly from BinaryData
-        session = std::make_unique<Ort::Session>(env, modelData, modelDataLength, sessionOptions);
+        MemoryAccounting::ScopedLoadMeasurement measurement;
+        auto newSession = std::make_unique<Ort::Session>(env, modelData, modelDataLength, sessionOptions);
 
         // Verify input shape (example: [1, 1024] for a frame of 1024 samples)
-        auto inputInfo = session->GetInputTypeInfo(0);
+        auto inputInfo = newSession->GetInputTypeInfo(0);
         auto inputTensorInfo = inputInfo.GetTensorTypeAndShapeInfo();
         auto inputShape = inputTensorInfo.GetShape();
         DBG("Input shape: [" + juce::String(inputShape[0]) + ", " + juce::String(inputShape[1]) + "]");
         if (inputShape.size() != 2 || (inputShape[0] != 1 && inputShape[0] != -1) || inputShape[1] != 1024) {
             DBG("Invalid input shape for CREPE model");
-            return false;
+            return nullptr;
         }
 
         // Verify output shape (example: [1, num_bins] for pitch probabilities)
-        auto outputInfo = session->GetOutputTypeInfo(0);
+        auto outputInfo = newSession->GetOutputTypeInfo(0);
         auto outputTensorInfo = outputInfo.GetTensorTypeAndShapeInfo();
         auto outputShape = outputTensorInfo.GetShape();
         DBG("Output shape: [" + juce::String(outputShape[0]) + ", " + juce::String(outputShape[1]) + "]");
         // Adjust validation based on actual model output
 
-        DBG("CREPE model initialized successfully");
-        return true;
+        auto model = std::make_shared<CrepeModel>();
+
+        // Names and the output buffer are fixed for the lifetime of the session
+        Ort::AllocatorWithDefaultOptions allocator;
+        model->inputName = newSession->GetInputNameAllocated(0, allocator).get();
+        model->outputName = newSession->GetOutputNameAllocated(0, allocator).get();
+        if (outputShape.size() == 2 && outputShape[1] > 0)
+            model->numBins = outputShape[1];
+        model->dynamicBatch = inputShape[0] == -1;
+        model->output.resize(static_cast<size_t>(model->numBins));
+        if (model->dynamicBatch && !lowMemory.load()) {
+            model->batchInput.resize(static_cast<size_t>(maxStreams) * frameSize);
+            model->batchOutput.resize(static_cast<size_t>(maxStreams * model->numBins));
+        }
+        model->session = std::move(newSession);
+        model->sessionBytes.store(measurement.getGrowth());
+
+        return model;
     }
     catch (const Ort::Exception& e) {
         DBG("ONNX Runtime error: " + juce::String(e.what()));
-        return false;
+        return nullptr;
+    }
+}
+
+void PitchDetector::prepare(double sampleRate) {
+    if (sampleRate > 0.0)
+        currentSampleRate.store(sampleRate);
+    onsetDetector.prepare(currentSampleRate.load());
+}
+
+std::vector<float> PitchDetector::createWarmUpFrame() const {
+    // A sung A4 rather than silence, so every kernel sees the data it will see later
+    std::vector<float> frame(frameSize);
+    const double sampleRate = currentSampleRate.load();
+    for (size_t i = 0; i < frameSize; ++i)
+        frame[i] = 0.5f * std::sin(juce::MathConstants<float>::twoPi * 440.0f * static_cast<float>(i / sampleRate));
+    return frame;
+}
+
+double PitchDetector::warmUpModel(CrepeModel& model, const std::vector<float>& frame, int iterations) {
+    float frequency = 0.0f;
+    float confidence = 0.0f;
+
+    // The arena grows to the peak these runs need and ORT keeps it reserved afterwards,
+    // so real frames of the same shape don't allocate again
+    MemoryAccounting::ScopedLoadMeasurement measurement;
+    double lastMs = 0.0;
+    for (int i = 0; i < iterations && !juce::Thread::currentThreadShouldExit(); ++i) {
+        const double startMs = juce::Time::getMillisecondCounterHiRes();
+        runCrepe(model, frame.data(), frequency, confidence);
+        lastMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+        if (i == 0)
+            DBG("CREPE first run: " + juce::String(lastMs, 2) + " ms");
+    }
+
+    // sidechain sources run as a batch, get that shape into the arena too
+    if (model.dynamicBatch && !model.batchInput.empty() && !juce::Thread::currentThreadShouldExit()) {
+        std::array<const float*, maxStreams> frames;
+        std::array<float, maxStreams> frequencies, confidences;
+        frames.fill(frame.data());
+        std::array<bool, maxStreams> detected;
+        for (int i = 0; i < 2; ++i)
+            runCrepeBatch(model, frames.data(), maxStreams, frequencies.data(), confidences.data(), detected.data());
     }
+
+    model.sessionBytes.fetch_add(measurement.getGrowth());
+    DBG("CREPE warmed up, steady state: " + juce::String(lastMs, 2) + " ms");
+    return lastMs;
+}
+
+void PitchDetector::warmUp(int iterations) {
+    const auto frame = createWarmUpFrame();
+
+    if (auto model = std::atomic_load(&session))
+        steadyStateLatencyMs.store(warmUpModel(*model, frame, iterations));
+
+    if (auto model = std::atomic_load(&tinySession); model && !juce::Thread::currentThreadShouldExit())
+        warmUpModel(*model, frame, iterations);
+
+    float frequency = 0.0f;
+    float confidence = 0.0f;
+    runDspEstimator(frame.data(), frequency, confidence);
+
+    warmedUp.store(true);
+}
+
+void PitchDetector::hotSwapModel(const void* modelData, size_t modelDataLength, bool tinyVariant,
+                                 std::function<void(bool)> onComplete) {
+    // ORT is done with the bytes once the session exists, the copy only has to outlive the job
+    juce::MemoryBlock data(modelData, modelDataLength);
+
+    auto completion = std::make_shared<HotSwapCompletion>(std::move(onComplete));
+
+    loaderPool.addJob([this, data, tinyVariant, completion] {
+        auto model = createSession(data.getData(), data.getSize());
+        const bool loaded = model != nullptr && !shuttingDown.load();
+
+        if (loaded) {
+            const double latencyMs = warmUpModel(*model, createWarmUpFrame(), 8);
+
+            auto& slot = tinyVariant ? tinySession : session;
+            auto oldModel = std::atomic_exchange(&slot, model);
+            model.reset();
+
+            if (tinyVariant)
+                qualityController.setTierAvailable(QualityController::Tier::tinyModel, true);
+            else
+                steadyStateLatencyMs.store(latencyMs);
+
+            DBG("CREPE " + juce::String(tinyVariant ? "tiny " : "") + "model swapped");
+            retireModel(std::move(oldModel));
+        }
+
+        completion->complete(loaded);
+    });
+}
+
+void PitchDetector::addMemoryUsage(MemoryAccounting::Report& report) const {
+    auto addModel = [&report](const std::shared_ptr<CrepeModel>& model, const char* name) {
+        if (!model) return;
+        report.add(juce::String(name) + " session", model->sessionBytes.load());
+        report.add(juce::String(name) + " io", MemoryAccounting::bytesOf(model->output)
+            + MemoryAccounting::bytesOf(model->batchInput) + MemoryAccounting::bytesOf(model->batchOutput));
+    };
+    addModel(std::atomic_load(&session), "crepe");
+    addModel(std::atomic_load(&tinySession), "crepe tiny");
+
+    report.add("pitch stream buffers", streamBufferBytes.load(std::memory_order_relaxed));
+}
+
+void PitchDetector::retireModel(std::shared_ptr<CrepeModel> model) {
+    std::atomic_exchange(&retiredModel, std::move(model));
 }
 
 void PitchDetector::processBuffer(const juce::AudioBuffer<float>& buffer) {
-    if (buffer.getNumChannels() < 1 || !session) return;
+    // the previous buffer's references are gone, a model swapped out since can go now
+    std::atomic_exchange(&retiredModel, std::shared_ptr<CrepeModel>());
 
-    // Use first channel (mono assumption; adjust for stereo if needed)
-    const float* channelData = buffer.getReadPointer(0);
-    int numSamples = buffer.getNumSamples();
+    const int numStreams = juce::jmin(buffer.getNumChannels(), maxStreams);
+    if (numStreams < 1 || !std::atomic_load(&session)) return;
 
+    const bool adapt = adaptiveQuality.load();
+    if (!adapt && qualityController.getCurrentTier() != QualityController::Tier::full) {
+        qualityController.reset();
+        applyQualityTier(QualityController::Tier::full);
+    }
 
+    // A stream that just joined starts in step with the first one, as if it had been silent so far
+    for (int s = juce::jmax(1, activeStreams); s < numStreams; ++s)
+        streamBuffers[static_cast<size_t>(s)].assign(streamBuffers[0].size(), 0.0f);
+    activeStreams = numStreams;
 
+    const int numSamples = buffer.getNumSamples();
+    for (int s = 0; s < numStreams; ++s) {
+        const float* channelData = buffer.getReadPointer(s);
+        auto& pending = streamBuffers[static_cast<size_t>(s)];
+        pending.insert(pending.end(), channelData, channelData + numSamples);
+    }
 
+    if (onsetFrames.load()) {
+        std::array<juce::int64, maxPendingOnsets> found;
+        const int numFound = onsetDetector.process(buffer.getReadPointer(0), numSamples, samplesReceived, found.data(), maxPendingOnsets);
+        for (int i = 0; i < numFound && numPendingOnsets < maxPendingOnsets; ++i)
+            pendingOnsets[static_cast<size_t>(numPendingOnsets++)] = found[static_cast<size_t>(i)];
+    }
+    else {
+        numPendingOnsets = 0;
+    }
+    samplesReceived += numSamples;
+
+    const auto popOnset = [this] {
+        std::copy(pendingOnsets.begin() + 1, pendingOnsets.begin() + numPendingOnsets, pendingOnsets.begin());
+        --numPendingOnsets;
+    };
+
+    // Regular frames every hop, onset frames slotted in between when they end first. All streams
+    // have the same amount buffered, starting at the same point of the timeline
+    for (;;) {
+        const juce::int64 bufferStart = samplesReceived - static_cast<juce::int64>(streamBuffers[0].size());
+        const juce::int64 frameLength = static_cast<juce::int64>(frameSize);
+        // a frame runs as soon as its own samples are in, a longer hop only spaces the frames out
+        const bool regularReady = samplesReceived - nextFrameStart >= frameLength;
+
+        juce::int64 onsetStart = 0;
+        bool onsetReady = false;
+        if (numPendingOnsets > 0) {
+            onsetStart = std::max(bufferStart, getOnsetFrameStart(pendingOnsets[0]));
+
+            // the regular frame that just ran or runs next starts about there anyway
+            const juce::int64 margin = frameLength / 4;
+            const juce::int64 lastRegularStart = nextFrameStart - static_cast<juce::int64>(hopSize);
+            if (onsetStart < lastRegularStart + margin || std::abs(onsetStart - nextFrameStart) <= margin) {
+                popOnset();
+                continue;
+            }
+            onsetReady = samplesReceived - onsetStart >= frameLength;
+        }
 
+        // whichever frame ends first, a regular frame that started before the onset still goes first
+        const bool runOnset = onsetReady && (!regularReady || onsetStart <= nextFrameStart);
+        if (!runOnset && !regularReady)
+            break;
+
+        const juce::int64 frameStart = runOnset ? onsetStart : nextFrameStart;
+        const int count = runOnset ? 1 : numStreams;
+        const auto tier = qualityController.getCurrentTier();
+        std::array<const float*, maxStreams> frames;
+        std::array<float, maxStreams> frequencies{}, confidences{};
+        std::array<bool, maxStreams> detected{};
+
+        for (int s = 0; s < count; ++s)
+            frames[static_cast<size_t>(s)] = streamBuffers[static_cast<size_t>(s)].data() + (frameStart - bufferStart);
+
+        // A hot swap takes effect between frames, this frame keeps whatever it picked up here
+        const auto model = tier == QualityController::Tier::tinyModel && std::atomic_load(&tinySession)
+            ? std::atomic_load(&tinySession)
+            : std::atomic_load(&session);
+
+        const auto analyse = [&](int first, int num) {
+            if (tier == QualityController::Tier::dspEstimator) {
+                for (int s = first; s < first + num; ++s) {
+                    const auto index = static_cast<size_t>(s);
+                    detected[index] = runDspEstimator(frames[index], frequencies[index], confidences[index]);
+                }
+            }
+            else {
+                runCrepeBatch(*model, frames.data() + first, num, frequencies.data() + first, confidences.data() + first, detected.data() + first);
+            }
+        };
+
+        // The budget for one frame is the stretch of audio a hop covers
+        const double budgetSeconds = static_cast<double>(hopSize) / currentSampleRate.load();
+        const double startMs = juce::Time::getMillisecondCounterHiRes();
+
+        // The main stream runs on its own and is all the quality controller sees, sidechains
+        // can't push it down a tier. They get what's left of the hop and sit a frame out
+        // while their last run wouldn't fit, the estimate decays so they come back
+        analyse(0, 1);
+        const double mainSeconds = (juce::Time::getMillisecondCounterHiRes() - startMs) * 0.001;
+
+        if (count > 1) {
+            if (!adapt || mainSeconds + sidechainSeconds <= budgetSeconds) {
+                const double sidechainStartMs = juce::Time::getMillisecondCounterHiRes();
+                analyse(1, count - 1);
+                sidechainSeconds = (juce::Time::getMillisecondCounterHiRes() - sidechainStartMs) * 0.001;
+            }
+            else {
+                sidechainSeconds *= 0.5;
+            }
+        }
 
+        const double inferenceSeconds = (juce::Time::getMillisecondCounterHiRes() - startMs) * 0.001;
+        if (inferenceHistogram != nullptr)
+            inferenceHistogram->record(inferenceSeconds);
 
+        if (!firstFrameLogged) {
+            firstFrameLogged = true;
+            DBG("First real frame: " + juce::String(inferenceSeconds * 1000.0, 2) + " ms (steady state "
+                + juce::String(steadyStateLatencyMs.load(), 2) + " ms)");
+        }
 
+        const auto endSample = frameStart + frameLength;
+        const auto onsetSample = runOnset ? pendingOnsets[0] : juce::int64(-1);
 
-    internalBuffer.insert(internalBuffer.end(), channelData, channelData + numSamples);
+        // a stream whose run failed or was skipped just has no frame this hop
+        for (int s = 0; s < count; ++s) {
+            const auto index = static_cast<size_t>(s);
+            if (!detected[index]) continue;
 
-    // Process frames when enough samples are available
-    while (internalBuffer.size() >= frameSize) {
-        std::vector<float> frame(internalBuffer.begin(), internalBuffer.begin() + frameSize);
+            currentConfidence[index].store(confidences[index]);
+            currentFrequency[index].store(frequencies[index]);
 
+            if (onFrame)
+                onFrame({ frequencies[index], confidences[index], endSample, s, onsetSample });
+        }
+
+        if (runOnset) {
+            // the budget is per regular hop, an onset frame's cost goes in with the next one
+            onsetSeconds += mainSeconds;
+            popOnset();
+        }
+        else {
+            nextFrameStart += static_cast<juce::int64>(hopSize);
+
+            if (adapt && qualityController.reportInference(mainSeconds + onsetSeconds, budgetSeconds))
+                applyQualityTier(qualityController.getCurrentTier());
+            onsetSeconds = 0.0;
+        }
+
+        // Remove processed samples, short of what a pending onset frame still needs. With a hop
+        // longer than the frame the next frame can start past what's buffered so far
+        juce::int64 keepFrom = std::min(nextFrameStart, samplesReceived);
+        if (numPendingOnsets > 0)
+            keepFrom = std::min(keepFrom, getOnsetFrameStart(pendingOnsets[0]));
+        if (keepFrom > bufferStart) {
+            for (int s = 0; s < numStreams; ++s) {
+                auto& pending = streamBuffers[static_cast<size_t>(s)];
+                pending.erase(pending.begin(), pending.begin() + (keepFrom - bufferStart));
+            }
+        }
+    }
+
+    size_t streamBytes = 0;
+    for (const auto& pending : streamBuffers)
+        streamBytes += MemoryAccounting::bytesOf(pending);
+    streamBufferBytes.store(streamBytes, std::memory_order_relaxed);
+}
+
+void PitchDetector::analyseFrames(const float* samples, int numFrames, int hop, int batchSize, std::vector<Frame>& results) {
+    const auto model = std::atomic_load(&session);
+    if (!model || numFrames <= 0) return;
+
+    const int batch = model->dynamicBatch ? juce::jmax(1, batchSize) : 1;
+    const int numBins = static_cast<int>(model->numBins);
+    std::vector<float> input(static_cast<size_t>(batch) * frameSize);
+    std::vector<float> output(static_cast<size_t>(batch * numBins));
+
+    const char* inputNames[] = { model->inputName.c_str() };
+    const char* outputNames[] = { model->outputName.c_str() };
+
+    for (int first = 0; first < numFrames; first += batch) {
+        const int count = juce::jmin(batch, numFrames - first);
+        for (int i = 0; i < count; ++i) {
+            const float* frame = samples + static_cast<size_t>(first + i) * hop;
+            std::copy(frame, frame + frameSize, input.begin() + static_cast<size_t>(i) * frameSize);
+        }
+
+        try {
+            const int64_t inputShape[] = { count, static_cast<int64_t>(frameSize) };
+            Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
+                memoryInfo, input.data(), static_cast<size_t>(count) * frameSize, inputShape, 2);
+
+            const int64_t outputShape[] = { count, model->numBins };
+            Ort::Value outputTensor = Ort::Value::CreateTensor<float>(
+                memoryInfo, output.data(), static_cast<size_t>(count * numBins), outputShape, 2);
+
+            CT_TRACE_SCOPE("crepeBatchRun");
+            model->session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputTensor, 1, outputNames, &outputTensor, 1);
+        }
+        catch (const Ort::Exception& e) {
+            DBG("ONNX Runtime error: " + juce::String(e.what()));
+            return;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            float frequency = 0.0f;
+            float confidence = 0.0f;
+            decodeOutput(output.data() + static_cast<size_t>(i * numBins), numBins, frequency, confidence);
+            results.push_back({ frequency, confidence, static_cast<juce::int64>(first + i) * hop + static_cast<juce::int64>(frameSize) });
+        }
+    }
+}
+
+bool PitchDetector::runCrepe(CrepeModel& model, const float* frame, float& frequency, float& confidence) {
+    try {
         // Prepare input tensor
-        std::vector<int64_t> inputShape = { 1, static_cast<int64_t>(frameSize) };
+        const int64_t inputShape[] = { 1, static_cast<int64_t>(frameSize) };
         Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
-            memoryInfo, frame.data(), frame.size(), inputShape.data(), inputShape.size());
+            memoryInfo, const_cast<float*>(frame), frameSize, inputShape, 2);
 
-        // Get input/output names
-        Ort::AllocatorWithDefaultOptions allocator;
-        auto inputName = session->GetInputNameAllocated(0, allocator);
-        auto outputName = session->GetOutputNameAllocated(0, allocator);
-        const char* inputNames[] = { inputName.get() };
-        const char* outputNames[] = { outputName.get() };
+        // Output goes straight into the preallocated buffer
+        const int64_t outputShape[] = { 1, model.numBins };
+        Ort::Value outputTensor = Ort::Value::CreateTensor<float>(
+            memoryInfo, model.output.data(), model.output.size(), outputShape, 2);
+
+        const char* inputNames[] = { model.inputName.c_str() };
+        const char* outputNames[] = { model.outputName.c_str() };
 
         // Run inference
-        std::vector<Ort::Value> outputTensors = session->Run(
-            Ort::RunOptions{ nullptr }, inputNames, &inputTensor, 1, outputNames, 1);
+        {
+            CT_TRACE_SCOPE("crepeRun");
+            model.session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputTensor, 1, outputNames, &outputTensor, 1);
+        }
+
+        decodeOutput(model.output.data(), static_cast<int>(model.numBins), frequency, confidence);
+
+        // Log the prediction details
+//        DBG("Max index: " + juce::String(maxIndex) + ", Confidence: " + juce::String(confidence) + ", Frequency: " + juce::String(frequency) + " Hz");
+        return true;
+    }
+    catch (const Ort::Exception& e) {
+        DBG("ONNX Runtime error: " + juce::String(e.what()));
+        return false;
+    }
+}
+
+void PitchDetector::runCrepeBatch(CrepeModel& model, const float* const* frames, int count, float* frequencies, float* confidences, bool* detected) {
+    if (count > 1 && model.dynamicBatch && !model.batchInput.empty() && runCrepeBatchedRun(model, frames, count, frequencies, confidences)) {
+        std::fill(detected, detected + count, true);
+        return;
+    }
+
+    // one run per stream, a stream that fails doesn't take the others with it
+    for (int i = 0; i < count; ++i)
+        detected[i] = runCrepe(model, frames[i], frequencies[i], confidences[i]);
+}
+
+bool PitchDetector::runCrepeBatchedRun(CrepeModel& model, const float* const* frames, int count, float* frequencies, float* confidences) {
+    try {
+        const int numBins = static_cast<int>(model.numBins);
+        for (int i = 0; i < count; ++i)
+            std::copy(frames[i], frames[i] + frameSize, model.batchInput.begin() + static_cast<size_t>(i) * frameSize);
+
+        const int64_t inputShape[] = { count, static_cast<int64_t>(frameSize) };
+        Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
+            memoryInfo, model.batchInput.data(), static_cast<size_t>(count) * frameSize, inputShape, 2);
 
-        if (!outputTensors.empty()) {
-            float* outputData = outputTensors[0].GetTensorMutableData<float>();
-            int numBins = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape()[1];
+        const int64_t outputShape[] = { count, model.numBins };
+        Ort::Value outputTensor = Ort::Value::CreateTensor<float>(
+            memoryInfo, model.batchOutput.data(), static_cast<size_t>(count * numBins), outputShape, 2);
 
-            // Find pitch with highest probability
-            auto maxIt = std::max_element(outputData, outputData + numBins);
-            int maxIndex = std::distance(outputData, maxIt);
-            currentConfidence = *maxIt;
-            currentFrequency = mapIndexToFrequency(maxIndex);
+        const char* inputNames[] = { model.inputName.c_str() };
+        const char* outputNames[] = { model.outputName.c_str() };
 
-            // Log the prediction details
-//            DBG("Max index: " + juce::String(maxIndex) + ", Confidence: " + juce::String(currentConfidence) + ", Frequency: " + juce::String(currentFrequency) + " Hz");
+        {
+            CT_TRACE_SCOPE("crepeBatchRun");
+            model.session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputTensor, 1, outputNames, &outputTensor, 1);
         }
 
-        // Remove processed samples
-        internalBuffer.erase(internalBuffer.begin(), internalBuffer.begin() + frameSize);
+        for (int i = 0; i < count; ++i)
+            decodeOutput(model.batchOutput.data() + static_cast<size_t>(i * numBins), numBins, frequencies[i], confidences[i]);
+        return true;
     }
+    catch (const Ort::Exception& e) {
+        DBG("ONNX Runtime error: " + juce::String(e.what()));
+        return false;
+    }
+}
+
+void PitchDetector::decodeOutput(const float* output, int numBins, float& frequency, float& confidence) const {
+    CT_TRACE_SCOPE("crepeDecode");
+
+    // Find pitch with highest probability
+    auto maxIt = std::max_element(output, output + numBins);
+    int maxIndex = static_cast<int>(std::distance(output, maxIt));
+    confidence = *maxIt;
+    frequency = mapIndexToFrequency(maxIndex);
+}
+
+bool PitchDetector::runDspEstimator(const float* frame, float& frequency, float& confidence) const {
+    CT_TRACE_SCOPE("dspEstimator");
+    const double sampleRate = currentSampleRate.load();
+    const int window = static_cast<int>(frameSize / 2);
+    const int minLag = std::max(2, static_cast<int>(sampleRate / 1500.0));
+    const int maxLag = window;
+
+    // Don't report a pitch for silence
+    float energy = 0.0f;
+    for (int j = 0; j < window; ++j)
+        energy += frame[j] * frame[j];
+    if (energy < 1.0e-6f) {
+        frequency = 0.0f;
+        confidence = 0.0f;
+        return true;
+    }
+
+    // Cumulative mean normalized difference, stop at the first dip under the threshold
+    const float threshold = 0.15f;
+    float runningSum = 0.0f;
+    float bestValue = 1.0f;
+    int bestLag = -1;
+    float previous = 1.0f;
+    float beforePrevious = 1.0f;
+
+    for (int lag = 1; lag < maxLag; ++lag) {
+        float difference = 0.0f;
+        for (int j = 0; j < window; ++j) {
+            const float delta = frame[j] - frame[j + lag];
+            difference += delta * delta;
+        }
+        runningSum += difference;
+        const float normalized = runningSum > 0.0f ? difference * lag / runningSum : 1.0f;
+
+        if (lag > minLag) {
+            // previous lag is a local minimum
+            if (previous <= normalized && previous <= beforePrevious && previous < bestValue) {
+                bestValue = previous;
+                bestLag = lag - 1;
+                if (bestValue < threshold) break;
+            }
+        }
+
+        beforePrevious = previous;
+        previous = normalized;
+    }
+
+    if (bestLag < 0) {
+        frequency = 0.0f;
+        confidence = 0.0f;
+        return true;
+    }
+
+    frequency = static_cast<float>(sampleRate / bestLag);
+    confidence = juce::jlimit(0.0f, 1.0f, 1.0f - bestValue);
+    return true;
+}
+
+void PitchDetector::applyQualityTier(QualityController::Tier tier) {
+    // reduced rate and tiny model both run on every other frame
+    hopSize = (tier == QualityController::Tier::reducedRate || tier == QualityController::Tier::tinyModel)
+        ? frameSize * 2
+        : frameSize;
+
+    DBG("Pitch quality tier: " + juce::String(QualityController::getTierName(tier)));
 }
 
 
-float PitchDetector::getCurrentFrequency() const { return currentFrequency; }
-float PitchDetector::getCurrentConfidence() const { return currentConfidence; }
+float PitchDetector::getCurrentFrequency(int stream) const { return currentFrequency[static_cast<size_t>(juce::jlimit(0, maxStreams - 1, stream))].load(); }
+float PitchDetector::getCurrentConfidence(int stream) const { return currentConfidence[static_cast<size_t>(juce::jlimit(0, maxStreams - 1, stream))].load(); }
 
 // most definitely there is a mapping function problem!
 
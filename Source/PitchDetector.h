@@ -1,37 +1,189 @@
 #pragma once
 #include <JuceHeader.h>
 #include <onnxruntime_cxx_api.h>
+#include <array>
 #include <vector>
+#include "QualityController.h"
+#include "LatencyHistogram.h"
+#include "OnsetDetector.h"
+#include "MemoryAccounting.h"
+#include "HotSwap.h"
 
 class PitchDetector {
 
 public:
+    // Sources analysed side by side, one per channel of the buffers handed to processBuffer
+    static constexpr int maxStreams = 4;
+
+    // One analysed frame, endSample is where the frame ends on the detector's input timeline
+    struct Frame {
+        float frequency;
+        float confidence;
+        juce::int64 endSample;
+        int stream = 0;
+        juce::int64 onsetSample = -1;  // set on the extra frames run at a note onset, where it is
+    };
+
     PitchDetector();
     ~PitchDetector();
 
     // Initialize the ONNX Runtime session with model data
     bool initialize(const void* modelData, size_t modelDataLength);
 
-    // Process audio buffer to detect pitch
+    // Optional smaller CREPE variant used when the quality controller steps down
+    bool initializeTinyModel(const void* modelData, size_t modelDataLength);
+    bool hasTinyModel() const { return std::atomic_load(&tinySession) != nullptr; }
+    // drops the tiny variant again and the ladder skips its tier, any thread
+    void releaseTinyModel();
+
+    // Sample rate of the incoming audio, sets the real-time budget per hop
+    void prepare(double sampleRate);
+
+    // Runs dummy frames through every loaded model so the first real frame doesn't pay for
+    // arena growth, kernel selection and lazy initialization. Cut short when the calling thread
+    // is asked to exit
+    void warmUp(int iterations = 8);
+    bool isWarmedUp() const { return warmedUp.load(); }
+    double getSteadyStateLatencyMs() const { return steadyStateLatencyMs.load(); }
+
+    // Loads a replacement model on a background thread, validates and warms it up, then swaps it
+    // in between two frames. Frames already running finish on the old model, nothing blocks.
+    void hotSwapModel(const void* modelData, size_t modelDataLength, bool tinyVariant = false,
+                      std::function<void(bool)> onComplete = nullptr);
+
+    // Process audio buffer to detect pitch. Every channel is its own source on the same sample
+    // clock, so each hop all sources have a frame ready and they go through the model as one
+    // [N, 1024] batch (one run per source when the model's batch dimension is fixed).
     void processBuffer(const juce::AudioBuffer<float>& buffer);
 
+    // Offline analysis of numFrames frames spaced hop samples apart from samples[0] on, endSample
+    // is relative to samples[0]. Runs batchSize frames per inference when the model's batch
+    // dimension is dynamic and one at a time otherwise. Always on the full model and it allocates,
+    // so never from the real-time path.
+    void analyseFrames(const float* samples, int numFrames, int hop, int batchSize, std::vector<Frame>& results);
+    int getFrameSize() const { return static_cast<int>(frameSize); }
+
+    // Called on the analysis thread for every frame, set it before audio starts flowing
+    void setFrameCallback(std::function<void(const Frame&)> callback) { onFrame = std::move(callback); }
+
+    // Every frame's inference time goes in here as well, same rule as the frame callback
+    void setInferenceHistogram(LatencyHistogram* histogram) { inferenceHistogram = histogram; }
+
+    // Samples taken in so far, the timeline Frame::endSample is on. Analysis thread only.
+    juce::int64 getSamplesReceived() const { return samplesReceived; }
+    double getSampleRate() const { return currentSampleRate.load(); }
+
     // Getters for pitch results
-    float getCurrentFrequency() const;
-    float getCurrentConfidence() const;
+    float getCurrentFrequency(int stream = 0) const;
+    float getCurrentConfidence(int stream = 0) const;
+
+    QualityController::Tier getQualityTier() const { return qualityController.getCurrentTier(); }
+    float getInferenceLoad() const { return qualityController.getSmoothedLoad(); }
+
+    // Off pins the full model and stops inference timing from changing the hop, so offline and
+    // replayed runs get the same frames however fast the machine is. Takes effect on the next buffer.
+    void setAdaptiveQuality(bool shouldAdapt) { adaptiveQuality.store(shouldAdapt); }
+
+    // An onset on stream 0 gets an extra frame starting just before it, run as soon as its samples
+    // are in instead of waiting for the regular hop to get there. On by default.
+    void setOnsetFrames(bool enabled) { onsetFrames.store(enabled); }
+
+    // Budget mode: sessions run without ORT's CPU arena and without the sidechain batch buffers
+    // (sidechains then run one frame at a time). Applies to models loaded after the call, so set
+    // it before initialize.
+    void setLowMemory(bool enabled) { lowMemory.store(enabled); }
+
+    // Adds the loaded models and the detector's buffers, safe from any thread
+    void addMemoryUsage(MemoryAccounting::Report& report) const;
 
 private:
+    // A CREPE session plus everything a frame needs that doesn't have to be looked up per run
+    struct CrepeModel {
+        std::unique_ptr<Ort::Session> session;
+        std::string inputName;
+        std::string outputName;
+        int64_t numBins = 360;
+        bool dynamicBatch = false; // input is [-1, 1024], offline analysis can batch frames
+        std::vector<float> output; // preallocated [1, numBins]
+        std::vector<float> batchInput;  // [maxStreams, 1024] and [maxStreams, numBins], dynamic batch only
+        std::vector<float> batchOutput;
+        std::atomic<size_t> sessionBytes{ 0 };  // resident set growth while loading and warming up
+    };
+
     Ort::Env env;
-    std::unique_ptr<Ort::Session> session;
+    // Only ever accessed through std::atomic_load/atomic_store so a hot swap can replace them
+    std::shared_ptr<CrepeModel> session;
+    std::shared_ptr<CrepeModel> tinySession;
     Ort::MemoryInfo memoryInfo;
-    std::vector<float> internalBuffer; // Accumulate audio samples
+    std::array<std::vector<float>, maxStreams> streamBuffers; // Accumulate audio samples
+    int activeStreams = 0;
+    juce::int64 samplesReceived = 0;
+    juce::int64 nextFrameStart = 0;  // where the next regular frame starts, on the input timeline
+
+    // onsets waiting for their frame, the buffers keep samples from the oldest one's frame start
+    OnsetDetector onsetDetector;
+    static constexpr int maxPendingOnsets = 4;
+    std::array<juce::int64, maxPendingOnsets> pendingOnsets{};
+    int numPendingOnsets = 0;
+    std::atomic<bool> onsetFrames{ true };
+    std::atomic<bool> lowMemory{ false };
+    std::atomic<size_t> streamBufferBytes{ 0 };  // published by the pitch thread after every buffer
+    juce::int64 getOnsetFrameStart(juce::int64 onset) const { return onset - static_cast<juce::int64>(frameSize / 4); }
+    std::function<void(const Frame&)> onFrame;
+    LatencyHistogram* inferenceHistogram = nullptr;
 
-    float currentFrequency = 0.0f;
-    float currentConfidence = 0.0f;
+    std::array<std::atomic<float>, maxStreams> currentFrequency{};
+    std::array<std::atomic<float>, maxStreams> currentConfidence{};
+    std::atomic<double> currentSampleRate{ 44100.0 };
     size_t frameSize = 1024; // Adjust based on model input requirements
+    size_t hopSize = 1024;
+
+    std::atomic<bool> warmedUp{ false };
+    std::atomic<double> steadyStateLatencyMs{ 0.0 };
+    bool firstFrameLogged = false;
+
+    QualityController qualityController;
+    std::atomic<bool> adaptiveQuality{ true };
+    double sidechainSeconds = 0.0;  // pitch thread, what the last sidechain run took
+    double onsetSeconds = 0.0;      // pitch thread, onset frames since the last regular one
+
+    // Creates a session and checks it against the [1, 1024] CREPE input
+    std::shared_ptr<CrepeModel> createSession(const void* modelData, size_t modelDataLength);
+
+    std::vector<float> createWarmUpFrame() const;
+    double warmUpModel(CrepeModel& model, const std::vector<float>& frame, int iterations);
+
+    // A swapped-out model waits here for the pitch thread, which drops it at the start of its next
+    // buffer when it can't be holding it any more. One that's still waiting when the next swap
+    // comes was never picked up again and goes on the loader thread.
+    std::shared_ptr<CrepeModel> retiredModel;  // only through std::atomic_load/atomic_exchange
+    void retireModel(std::shared_ptr<CrepeModel> model);
+    std::atomic<bool> shuttingDown{ false };
+
+    // Runs one frame through a CREPE session, returns false if no output was produced
+    bool runCrepe(CrepeModel& model, const float* frame, float& frequency, float& confidence);
+
+    // Same for one frame per stream, batched into a single run when the model allows it. detected
+    // says which streams got an output, when the batched run fails each stream runs on its own
+    void runCrepeBatch(CrepeModel& model, const float* const* frames, int count, float* frequencies, float* confidences, bool* detected);
+    bool runCrepeBatchedRun(CrepeModel& model, const float* const* frames, int count, float* frequencies, float* confidences);
+
+    // Time-domain fallback (YIN style difference function), no inference involved
+    bool runDspEstimator(const float* frame, float& frequency, float& confidence) const;
+
+    void applyQualityTier(QualityController::Tier tier);
+
+    // Picks the most likely bin of a CREPE output, its probability is the confidence
+    void decodeOutput(const float* output, int numBins, float& frequency, float& confidence) const;
 
     // Helper to map model output to frequency
     float mapIndexToFrequency(int index) const;
 
+    // Benchmarks/ times the kernels above directly
+    friend struct BenchmarkAccess;
+
+    // Runs hot swaps, declared last so pending swaps finish before anything else is destroyed
+    juce::ThreadPool loaderPool{ 1 };
 
-};
 
+};
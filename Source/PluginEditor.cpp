@@ -13,37 +13,99 @@ CounterTuneIOAudioProcessorEditor::~CounterTuneIOAudioProcessorEditor()
     stopTimer();
 }
 
-std::string CounterTuneIOAudioProcessorEditor::vectorToString(const std::vector<int>& vec)
+juce::String CounterTuneIOAudioProcessorEditor::summaryToString(const LatencyHistogram::Summary& summary)
 {
-    std::ostringstream oss;
-    oss << "[";
-    for (size_t i = 0; i < vec.size(); ++i)
-    {
-        if (i > 0) oss << ", "; // Add comma and space between elements
-        oss << vec[i];
-    }
-    oss << "]";
-    return oss.str();
+    // p50 / p99 / max
+    return juce::String(summary.p50Ms, 2) + " / " + juce::String(summary.p99Ms, 2) + " / " + juce::String(summary.maxMs, 2) + " ms";
 }
 
 void CounterTuneIOAudioProcessorEditor::timerCallback() {
+    const int pitchStatus = audioProcessor.isPitchDetectorReady() ? static_cast<int>(audioProcessor.getPitchQualityTier()) : -1;
+    if (pitchStatus != shownPitchStatus) {
+        shownPitchStatus = pitchStatus;
+        pitchStatusLabel.setText(pitchStatus >= 0
+            ? "STATUS: READY (" + juce::String(QualityController::getTierName(audioProcessor.getPitchQualityTier())) + ")"
+            : "STATUS: LOADING...", juce::dontSendNotification);
+    }
+
+    const auto& metrics = audioProcessor.getPerformanceMetrics();
+
+    // pitch values only move when frames come out of the detector
+    const auto pitchVersion = audioProcessor.getPitchVersion();
+    if (pitchVersion != shownPitchVersion) {
+        shownPitchVersion = pitchVersion;
 
+        juce::String frequencyText = "FREQ: " + juce::String(audioProcessor.getCurrentFrequency(), 2) + " Hz";
+        for (int source = 1; source < audioProcessor.getNumPitchSources(); ++source)
+            frequencyText << "\nSC" << source << ": " << juce::String(audioProcessor.getCurrentFrequency(source), 1) << " Hz";
+        frequencyLabel.setText(frequencyText, juce::dontSendNotification);
+        confidenceLabel.setText("CONFIDENCE: " + juce::String(audioProcessor.getCurrentConfidence(), 3), juce::dontSendNotification);
+    }
 
-    pitchStatusLabel.setText(audioProcessor.isPitchDetectorReady() ? "STATUS: READY" : "STATUS: LOADING...", juce::dontSendNotification);
-    frequencyLabel.setText("FREQ: " + juce::String(audioProcessor.getCurrentFrequency(), 2) + " Hz", juce::dontSendNotification);
-    confidenceLabel.setText("CONFIDENCE: " + juce::String(audioProcessor.getCurrentConfidence(), 3), juce::dontSendNotification);
+    // the metrics follow the blocks instead, they have to keep moving when no frames come out
+    if (++metricsTicks >= metricsRefreshTicks) {
+        metricsTicks = 0;
+
+        const auto blockCount = metrics.getBlockCount();
+        if (blockCount != shownBlockCount) {
+            shownBlockCount = blockCount;
+
+            pitchMetricsLabel.setText("DSP: " + juce::String(metrics.getDspLoad() * 100.0f, 1) + "% (PEAK " + juce::String(metrics.getPeakDspLoad() * 100.0f, 1) + "%)\n"
+                + "BLOCK: " + summaryToString(metrics.blockDuration.getSummary()) + "\n"
+                + "INFERENCE: " + summaryToString(metrics.pitchInference.getSummary()) + "\n"
+                + "PITCH LATENCY: " + summaryToString(metrics.pitchLatency.getSummary()) + "\n"
+                + "MISSED: " + juce::String(metrics.getMissedDeadlines()) + "  DROPPED: " + juce::String(metrics.getDroppedSamples()), juce::dontSendNotification);
+
+            const auto budget = audioProcessor.getMemoryBudget();
+            generationMetricsLabel.setText("GENERATION: " + summaryToString(metrics.generationLatency.getSummary()) + "\n"
+                + "MEMORY: " + MemoryAccounting::formatBytes(audioProcessor.getMemoryReport().getInstanceBytes())
+                + (budget > 0 ? (audioProcessor.isOverMemoryBudget() ? " (OVER BUDGET " : " (BUDGET ") + MemoryAccounting::formatBytes(budget) + ")"
+                              : juce::String()), juce::dontSendNotification);
+        }
+    }
 
-    // to do: set melodyStatusLabel text
+    const auto capturedVersion = audioProcessor.getCapturedMelodyVersion();
+    if (capturedVersion != shownCapturedVersion) {
+        shownCapturedVersion = capturedVersion;
+        inputMelodyRoll.setPhrase(phraseScratch.data(), audioProcessor.readCapturedMelody(phraseScratch.data(), PianoRoll::maxSlots));
+    }
 
-    // to do: set inputMelodyLabel text
+    const auto generatedVersion = audioProcessor.getGeneratedMelodyVersion();
+    if (generatedVersion != shownGeneratedVersion) {
+        shownGeneratedVersion = generatedVersion;
+        generatedMelodyRoll.setPhrase(phraseScratch.data(), audioProcessor.readGeneratedMelody(phraseScratch.data(), PianoRoll::maxSlots));
+    }
 
-    inputMelodyLabel.setText("INPUT: " + vectorToString(audioProcessor.getCapturedMelody()), juce::dontSendNotification);
+    // the key follows the captured phrases and gets reset on its own, it isn't tied to a generation
+    const int generatorStatus = audioProcessor.isGeneratorReady() ? 1 : 0;
+    const auto keyName = audioProcessor.getDetectedKeyName();
+    if (generatorStatus != shownGeneratorStatus || keyName != shownKeyName) {
+        shownGeneratorStatus = generatorStatus;
+        shownKeyName = keyName;
+        melodyStatusLabel.setText(generatorStatus != 0
+            ? (keyName.isEmpty() ? juce::String("STATUS: READY") : "STATUS: READY (" + keyName.toUpperCase() + ")")
+            : "STATUS: LOADING...", juce::dontSendNotification);
+    }
 
-//    auto melodySnapshot = audioProcessor.getCapturedMelodySnapshot();
-//    inputMelodyLabel.setText("INPUT: " + vectorToString(melodySnapshot), juce::dontSendNotification);
+    const int captureStatus = audioProcessor.isCapturingSession() ? 1 : 0;
+    if (captureStatus != shownCaptureStatus) {
+        shownCaptureStatus = captureStatus;
+        captureSessionButton.setButtonText(captureStatus != 0 ? "STOP CAPTURE" : "CAPTURE SESSION");
+    }
+}
 
+void CounterTuneIOAudioProcessorEditor::selectSampleSlot(int slot)
+{
+    // clicking the slot that's playing switches back to MIDI only
+    audioProcessor.setSampleSlot(audioProcessor.getSampleSlot() == slot ? SamplePlayer::noSlot : slot);
+    updateSampleButtons();
+}
 
-    // to do: set generatedMelodyLabel text
+void CounterTuneIOAudioProcessorEditor::updateSampleButtons()
+{
+    juce::TextButton* buttons[] = { &sampleButtonA, &sampleButtonB, &sampleButtonC, &sampleButtonD, &sampleButtonE };
+    for (int slot = 0; slot < SamplePlayer::numSlots; ++slot)
+        buttons[slot]->setToggleState(audioProcessor.getSampleSlot() == slot, juce::dontSendNotification);
 }
 
 void CounterTuneIOAudioProcessorEditor::paint(juce::Graphics& g)
@@ -67,21 +129,27 @@ void CounterTuneIOAudioProcessorEditor::resized()
     pitchStatusLabel.setText("STATUS: LOADING...", juce::dontSendNotification);
     pitchStatusLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     pitchStatusLabel.setJustificationType(juce::Justification::centredLeft);
-    pitchStatusLabel.setBounds(212, 75, 588, 58);
+    pitchStatusLabel.setBounds(212, 75, 288, 58);
     addAndMakeVisible(pitchStatusLabel);
 
     frequencyLabel.setText("FREQ: ", juce::dontSendNotification);
     frequencyLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     frequencyLabel.setJustificationType(juce::Justification::centredLeft);
-    frequencyLabel.setBounds(212, 133, 588, 58);
+    frequencyLabel.setBounds(212, 133, 288, 58);
     addAndMakeVisible(frequencyLabel);
 
     confidenceLabel.setText("CONFIDENCE: ", juce::dontSendNotification);
     confidenceLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     confidenceLabel.setJustificationType(juce::Justification::centredLeft);
-    confidenceLabel.setBounds(212, 191, 588, 59);
+    confidenceLabel.setBounds(212, 191, 288, 59);
     addAndMakeVisible(confidenceLabel);
 
+    // p50 / p99 / max of everything on the pitch path, next to the values they're about
+    pitchMetricsLabel.setColour(juce::Label::textColourId, juce::Colours::white);
+    pitchMetricsLabel.setJustificationType(juce::Justification::centredLeft);
+    pitchMetricsLabel.setBounds(500, 75, 300, 175);
+    addAndMakeVisible(pitchMetricsLabel);
+
     melodyGenerationLabel.setText("MELODY GENERATION", juce::dontSendNotification);
     melodyGenerationLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     melodyGenerationLabel.setJustificationType(juce::Justification::centredLeft);
@@ -91,21 +159,32 @@ void CounterTuneIOAudioProcessorEditor::resized()
     melodyStatusLabel.setText("STATUS: LOADING...", juce::dontSendNotification);
     melodyStatusLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     melodyStatusLabel.setJustificationType(juce::Justification::centredLeft);
-    melodyStatusLabel.setBounds(212, 250, 588, 58);
+    melodyStatusLabel.setBounds(212, 250, 288, 58);
     addAndMakeVisible(melodyStatusLabel);
 
-    inputMelodyLabel.setText("INPUT: [-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1]", juce::dontSendNotification);
+    generationMetricsLabel.setColour(juce::Label::textColourId, juce::Colours::white);
+    generationMetricsLabel.setJustificationType(juce::Justification::centredLeft);
+    generationMetricsLabel.setBounds(500, 250, 300, 58);
+    addAndMakeVisible(generationMetricsLabel);
+
+    inputMelodyLabel.setText("INPUT:", juce::dontSendNotification);
     inputMelodyLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     inputMelodyLabel.setJustificationType(juce::Justification::centredLeft);
-    inputMelodyLabel.setBounds(212, 308, 588, 58);
+    inputMelodyLabel.setBounds(212, 308, 76, 58);
     addAndMakeVisible(inputMelodyLabel);
 
-    generatedMelodyLabel.setText("OUTPUT: [-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1]", juce::dontSendNotification);
+    inputMelodyRoll.setBounds(288, 312, 500, 50);
+    addAndMakeVisible(inputMelodyRoll);
+
+    generatedMelodyLabel.setText("OUTPUT:", juce::dontSendNotification);
     generatedMelodyLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     generatedMelodyLabel.setJustificationType(juce::Justification::centredLeft);
-    generatedMelodyLabel.setBounds(212, 366, 588, 59);
+    generatedMelodyLabel.setBounds(212, 366, 76, 59);
     addAndMakeVisible(generatedMelodyLabel);
 
+    generatedMelodyRoll.setBounds(288, 370, 500, 50);
+    addAndMakeVisible(generatedMelodyRoll);
+
     sampleCollectionLabel.setText("SAMPLE COLLECTION", juce::dontSendNotification);
     sampleCollectionLabel.setColour(juce::Label::textColourId, juce::Colours::white);
     sampleCollectionLabel.setJustificationType(juce::Justification::centredLeft);
@@ -121,43 +200,50 @@ void CounterTuneIOAudioProcessorEditor::resized()
             audioProcessor.playTestFile();
         };
 
+    captureSessionButton.setButtonText(audioProcessor.isCapturingSession() ? "STOP CAPTURE" : "CAPTURE SESSION");
+    captureSessionButton.setBounds(174, 12, 150, 50);
+    addAndMakeVisible(captureSessionButton);
+    captureSessionButton.onClick = [this]
+        {
+            if (audioProcessor.isCapturingSession())
+            {
+                audioProcessor.stopSessionCapture();
+            }
+            else
+            {
+                // replay with CounterTuneReplay
+                const auto folder = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("CounterTune Sessions");
+                folder.createDirectory();
+                const auto file = folder.getChildFile("session_" + juce::Time::getCurrentTime().formatted("%Y%m%d_%H%M%S") + ".ctsc");
+                if (!audioProcessor.startSessionCapture(file))
+                    DBG("Couldn't start session capture to " + file.getFullPathName());
+            }
+        };
+
     sampleButtonA.setButtonText("A");
     sampleButtonA.setBounds(212, 488, 50, 50);
     addAndMakeVisible(sampleButtonA);
-    sampleButtonA.onClick = [this]
-        {
-            DBG("sampleButtonA clicked");
-        };
+    sampleButtonA.onClick = [this] { selectSampleSlot(0); };
 
     sampleButtonB.setButtonText("B");
     sampleButtonB.setBounds(274, 488, 50, 50);
     addAndMakeVisible(sampleButtonB);
-    sampleButtonB.onClick = [this]
-        {
-            DBG("sampleButtonB clicked");
-        };
+    sampleButtonB.onClick = [this] { selectSampleSlot(1); };
 
     sampleButtonC.setButtonText("C");
     sampleButtonC.setBounds(336, 488, 50, 50);
     addAndMakeVisible(sampleButtonC);
-    sampleButtonC.onClick = [this]
-        {
-            DBG("sampleButtonC clicked");
-        };
+    sampleButtonC.onClick = [this] { selectSampleSlot(2); };
 
     sampleButtonD.setButtonText("D");
     sampleButtonD.setBounds(398, 488, 50, 50);
     addAndMakeVisible(sampleButtonD);
-    sampleButtonD.onClick = [this]
-        {
-            DBG("sampleButtonD clicked");
-        };
+    sampleButtonD.onClick = [this] { selectSampleSlot(3); };
 
     sampleButtonE.setButtonText("E");
     sampleButtonE.setBounds(460, 488, 50, 50);
     addAndMakeVisible(sampleButtonE);
-    sampleButtonE.onClick = [this]
-        {
-            DBG("sampleButtonE clicked");
-        };
+    sampleButtonE.onClick = [this] { selectSampleSlot(4); };
+
+    updateSampleButtons();
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "PianoRoll.h"
 
 class CounterTuneIOAudioProcessorEditor  : public juce::AudioProcessorEditor, public juce::Timer
 {
@@ -12,22 +13,29 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
 
-    static std::string vectorToString(const std::vector<int>& vec);
+    static juce::String summaryToString(const LatencyHistogram::Summary& summary);
 
 private:
     void timerCallback() override;
+    void selectSampleSlot(int slot);
+    void updateSampleButtons();
 
     juce::Label pitchDetectionLabel;
     juce::Label pitchStatusLabel;
     juce::Label frequencyLabel;
     juce::Label confidenceLabel;
+    juce::Label pitchMetricsLabel;
     juce::Label melodyGenerationLabel;
     juce::Label melodyStatusLabel;
+    juce::Label generationMetricsLabel;
     juce::Label inputMelodyLabel;
     juce::Label generatedMelodyLabel;
+    PianoRoll inputMelodyRoll{ juce::Colours::cyan };
+    PianoRoll generatedMelodyRoll{ juce::Colours::orange };
     juce::Label sampleCollectionLabel;
 
     juce::TextButton playFileButton;
+    juce::TextButton captureSessionButton;
     juce::TextButton sampleButtonA;
     juce::TextButton sampleButtonB;
     juce::TextButton sampleButtonC;
@@ -36,5 +44,20 @@ private:
 
     CounterTuneIOAudioProcessor& audioProcessor;
 
+    // what's on screen, the timer only rebuilds the parts whose source moved on
+    juce::uint32 shownPitchVersion = ~0u;
+    juce::uint32 shownCapturedVersion = ~0u;
+    juce::uint32 shownGeneratedVersion = ~0u;
+    int shownPitchStatus = -2;  // -1 = loading, otherwise the quality tier
+    int shownGeneratorStatus = -1;
+    int shownCaptureStatus = -1;
+    juce::String shownKeyName;
+    std::array<int, PianoRoll::maxSlots> phraseScratch{};
+
+    // the metrics move with every block, a few refreshes a second is plenty to read them
+    static constexpr int metricsRefreshTicks = 5;
+    int metricsTicks = 0;
+    juce::uint64 shownBlockCount = ~0ull;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CounterTuneIOAudioProcessorEditor)
 };
@@ -1,65 +1,86 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+#ifndef COUNTERTUNE_MEMORY_BUDGET_MB
+ #define COUNTERTUNE_MEMORY_BUDGET_MB 0
+#endif
+
+namespace {
+    // -1 until setDefaultMemoryBudget is called
+    std::atomic<juce::int64> defaultMemoryBudget{ -1 };
+}
+
 CounterTuneIOAudioProcessor::CounterTuneIOAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
     : AudioProcessor(BusesProperties()
 #if ! JucePlugin_IsMidiEffect
 #if ! JucePlugin_IsSynth
         .withInput("Input", juce::AudioChannelSet::stereo(), true)
+        .withInput("Sidechain 1", juce::AudioChannelSet::mono(), false)
+        .withInput("Sidechain 2", juce::AudioChannelSet::mono(), false)
+        .withInput("Sidechain 3", juce::AudioChannelSet::mono(), false)
 #endif
         .withOutput("Output", juce::AudioChannelSet::stereo(), true)
 #endif
     ),
     pitchDetector(std::make_unique<PitchDetector>()),
-    pitchThread(std::make_unique<PitchDetectionThread>(*pitchDetector)),
-    melodyGenerator(std::make_unique<MelodyGenerator>())
+    pitchThread(std::make_unique<PitchDetectionThread>(*this, *pitchDetector)),
+    melodyGenerator(std::make_unique<MelodyGenerator>()),
+    generatorThread(std::make_unique<MelodyGenerationThread>(*this))
 #endif
 {
-
-
-    if (!pitchDetector->initialize(BinaryData::crepe_small_onnx, BinaryData::crepe_small_onnxSize))
-    {
-        DBG("Failed to initialize CREPE model");
-        pitchDetectorReady.store(false);
-    }
-    else
-    {
-        pitchDetectorReady.store(true);
-        DBG("CREPE model loaded successfully");
-    }
-
-    pitchThread->startThread();
-
-
-
-    if (!melodyGenerator->initialize(BinaryData::melody_model_onnx, BinaryData::melody_model_onnxSize))
-    {
-        DBG("Failed to initialize melody model");
-    }
-    else
+    // Every analysed frame goes straight into the capture segmenter, on the pitch thread
+    pitchDetector->setFrameCallback([this](const PitchDetector::Frame& frame)
+        {
+            if (frame.stream == 0)
+                melodyCapture.pushFrame(MelodyCapture::frequencyToMidiNote(frame.frequency), frame.confidence, frame.onsetSample);
+            pitchVersion.fetch_add(1, std::memory_order_relaxed);
+
+            if (pitchFrameListener)
+                pitchFrameListener(frame);
+
+            // the sidechains arrive with the main input, one measurement per batch is enough. and
+            // analysed inside processBlock there's no handoff to measure at all
+            if (frame.stream != 0 || isNonRealtime())
+                return;
+
+            // the frame's newest sample arrived this long before the end of the chunk it came in
+            const double samplesBehind = static_cast<double>(pitchChunkEndSample - frame.endSample);
+            const double sinceArrival = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - pitchChunkArrivalTicks);
+            metrics.pitchLatency.record(sinceArrival + samplesBehind / pitchDetector->getSampleRate());
+        });
+    pitchDetector->setInferenceHistogram(&metrics.pitchInference);
+
+    // has to be in place before the threads below load the models
+    if (memoryBudget > 0)
     {
-        DBG("Melody model loaded successfully");
+        pitchDetector->setLowMemory(true);
+        melodyGenerator->setLowMemory(true);
+        samplePlayer.setLowMemory(true);
+        DBG("Memory budget: " + MemoryAccounting::formatBytes(memoryBudget));
     }
 
-    // generatorThread->startThread();
-
-
+    setRandomSeed(static_cast<juce::uint32>(juce::Random::getSystemRandom().nextInt()));
 
 
+    // Both models load and warm up on their own threads, the ready flags flip once that's done
+    pitchThread->startThread();
 
 
-    initializeAudioPlayback();
 
+    generatorThread->startThread();
 
 }
 
 CounterTuneIOAudioProcessor::~CounterTuneIOAudioProcessor()
 {
-
-    pitchThread->stopThread(1000);
-
-
+    // Both threads may still be loading or warming up, inside ORT. They check between steps and
+    // leave early, but a step in progress has to finish: killing a thread there would pull the
+    // detector and generator out from under it. A plugin scan creates and destroys right away.
+    pitchThread->signalThreadShouldExit();
+    generatorThread->signalThreadShouldExit();
+    pitchThread->stopThread(-1);
+    generatorThread->stopThread(-1);
 }
 
 
@@ -127,24 +148,21 @@ void CounterTuneIOAudioProcessor::changeProgramName(int index, const juce::Strin
 void CounterTuneIOAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     active = true;
-    updateSamplesPerSymbol();
+    phraseClock.setFallbackTempo(fallbackTempo.load());
+    phraseClock.prepare(sampleRate);
 
-    if (transportSource != nullptr)
-        transportSource->prepareToPlay(samplesPerBlock, sampleRate);
+    pitchDetector->prepare(sampleRate);
 
-    if (resamplingSource != nullptr)
-        resamplingSource->prepareToPlay(samplesPerBlock, sampleRate);
+    sourceBuffer.setSize(maxPitchSources, samplesPerBlock);
+    updatePitchSources();
+
+    samplePlayer.prepare(sampleRate, samplesPerBlock);
+    schedulerMidi.ensureSize(256);
 }
 
 void CounterTuneIOAudioProcessor::releaseResources()
 {
     active = false;
-
-    if (transportSource != nullptr)
-        transportSource->releaseResources();
-
-    if (resamplingSource != nullptr)
-        resamplingSource->releaseResources();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -162,6 +180,14 @@ bool CounterTuneIOAudioProcessor::isBusesLayoutSupported(const BusesLayout& layo
 #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+
+    // sidechains only feed the pitch path, mono or stereo or switched off
+    for (int bus = 1; bus < layouts.inputBuses.size(); ++bus)
+    {
+        const auto set = layouts.getChannelSet(true, bus);
+        if (!set.isDisabled() && set != juce::AudioChannelSet::mono() && set != juce::AudioChannelSet::stereo())
+            return false;
+    }
 #endif
 
     return true;
@@ -171,6 +197,11 @@ bool CounterTuneIOAudioProcessor::isBusesLayoutSupported(const BusesLayout& layo
 
 void CounterTuneIOAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) {
 
+    CT_REALTIME_SECTION_IF(!isNonRealtime());
+    CT_TRACE_THREAD("Audio");
+    CT_TRACE_SCOPE("processBlock");
+    const PerformanceMetrics::ScopedBlockTimer blockTimer(metrics, buffer.getNumSamples(), getSampleRate());
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -179,23 +210,29 @@ void CounterTuneIOAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
-    // If the audios playing, mix it in
-    if (transportSource->isPlaying() && resamplingSource != nullptr)
-    {
-        juce::AudioBuffer<float> testBuffer(2, buffer.getNumSamples());
-        juce::AudioSourceChannelInfo channelInfo(testBuffer);
-        resamplingSource->getNextAudioBlock(channelInfo);
+    // If the test note's playing, mix it in so the pitch path hears it
+    samplePlayer.renderTestNote(buffer);
+
+    sessionRecorder.recordBlock(buffer, getPlayHead());
+
+    // where this block starts on the pitch path's timeline, the slots below are placed on it too
+    const juce::int64 blockPitchSample = pitchTimelineSample;
 
-        int numChannels = std::min(buffer.getNumChannels(), 2);
-        for (int channel = 0; channel < numChannels; ++channel)
+    if (isNonRealtime())
+    {
+        // every frame this block completes is in before its slots get captured below
+        if (pitchDetectorReady.load())
         {
-            buffer.addFrom(channel, 0, testBuffer, channel, 0, buffer.getNumSamples());
+            sourceBuffer.setSize(numPitchSources.load(), buffer.getNumSamples(), false, false, true);
+            downmixPitchSources(buffer, 0, buffer.getNumSamples(), sourceBuffer, 0);
+            pitchDetector->processBuffer(sourceBuffer);
+            pitchTimelineSample += buffer.getNumSamples();
         }
     }
-
-    if (pitchThread)
+    else if (pitchThread)
     {
-        pitchThread->processAudio(buffer);
+        CT_TRACE_SCOPE("ringHandoff");
+        pitchTimelineSample += pitchThread->processAudio(buffer);
     }
 
 
@@ -207,43 +244,108 @@ void CounterTuneIOAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
 
 
 
-    if (captureCounter >= samplesPerSymbol)
-    {
-        updateSamplesPerSymbol();
+    // Sixteenth boundaries inside this block, straight from the host transport
+    phraseClock.setFallbackTempo(fallbackTempo.load(std::memory_order_relaxed));
+    phraseClock.advance(getPlayHead(), buffer.getNumSamples());
 
-        // Capture logic
-        if (inputNoteActive)
-        {
-
-        }
+    // a reopened project's phrases, the counter-melody takes over at the next phrase start
+    if (restoredPhrases.getVersion() != appliedRestoreVersion && !awaitingResponse.load())
+        applyRestoredPhrases();
 
-        capturePosition++;
-
-        if ((capturePosition % 32) == 0)
-        {
+    // Whatever the counter-melody was playing stops with the transport or where the host jumped away from
+    schedulerMidi.clear();
+    if (phraseClock.didStop() || phraseClock.didJump())
+        midiScheduler.stopSounding(0, schedulerMidi);
 
+    if (phraseClock.didJump())
+    {
+        // started, relocated or looped: whatever was captured so far no longer lines up
+        shouldResetCapturedMelody = true;
+        loadScheduledPhrase();
+    }
 
+    if (shouldResetCapturedMelody)
+    {
+        melodyCapture.reset();
+        shouldResetCapturedMelody = false;
+    }
 
+    for (int i = 0; i < phraseClock.getNumSlotEvents(); ++i)
+    {
+        const auto& slot = phraseClock.getSlotEvent(i);
+        capturePosition = PhraseClock::getPhrasePosition(slot.slotIndex, phraseLength);
 
+        if (capturePosition == 0)
+        {
+            // a new counter-melody only takes over at a phrase boundary
+            loadScheduledPhrase();
+        }
 
+        // Capture logic
+        CT_TRACE_SCOPE("captureSlot");
+        if (melodyCapture.captureSlot(capturePosition, blockPitchSample + slot.sampleOffset))
+        {
+            // a full phrase is in, hand it to the UI and the generator
+            capturedMelody.publish(melodyCapture.getPhrase(), melodyCapture.getPhraseLength());
+            awaitingResponse.store(true);
+            generationRequestTicks.store(juce::Time::getHighResolutionTicks());
+
+            // offline nothing is waiting on the block, answer before the next phrase starts
+            if (isNonRealtime())
+                generateCounterMelody();
+            else
+                generationRequested.store(true);
+        }
 
+        midiScheduler.renderSlot(capturePosition, slot.sampleOffset, schedulerMidi);
+    }
 
+    // after the pitch path took its copy, the counter-melody mustn't feed back into it. only the
+    // scheduler's notes play through the sampler, host notes just pass through to the output
+    {
+        CT_TRACE_SCOPE("samplePlayer");
+        samplePlayer.render(buffer, schedulerMidi);
+    }
+    midiMessages.addEvents(schedulerMidi, 0, buffer.getNumSamples(), 0);
 
-        }
 
 
 
+}
 
-        testInt += 1;
-        DBG("sixteenth note: " + juce::String(testInt));
+void CounterTuneIOAudioProcessor::updatePitchSources()
+{
+    // the layout only changes while we're not playing, prepareToPlay follows every change
+    int count = 1;
+    for (int bus = 0; bus < maxPitchSources; ++bus)
+    {
+        auto* input = bus < getBusCount(true) ? getBus(true, bus) : nullptr;
+        auto& source = pitchSources[static_cast<size_t>(bus)];
+        source.numChannels = input != nullptr && input->isEnabled() ? input->getNumberOfChannels() : 0;
+        source.firstChannel = source.numChannels > 0 ? getChannelIndexInProcessBlockBuffer(true, bus, 0) : 0;
 
-        captureCounter -= samplesPerSymbol;
+        if (bus > 0 && source.numChannels > 0)
+            count = bus + 1;
     }
-    captureCounter += buffer.getNumSamples();
-
-
+    numPitchSources.store(count);
+}
 
+void CounterTuneIOAudioProcessor::downmixPitchSources(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                                                      juce::AudioBuffer<float>& dest, int destStartSample) const noexcept
+{
+    const int numSources = juce::jmin(numPitchSources.load(), dest.getNumChannels());
+    for (int s = 0; s < numSources; ++s)
+    {
+        const auto& source = pitchSources[static_cast<size_t>(s)];
+        inputDownmix[static_cast<size_t>(s)].process(buffer, source.firstChannel, source.numChannels, startSample, numSamples,
+                                                     dest.getWritePointer(s, destStartSample));
+    }
+}
 
+void CounterTuneIOAudioProcessor::loadScheduledPhrase()
+{
+    const int length = generatedMelody.read(scheduledPhrase.data(), static_cast<int>(scheduledPhrase.size()));
+    midiScheduler.loadPhrase(scheduledPhrase.data(), length);
 }
 
 bool CounterTuneIOAudioProcessor::hasEditor() const
@@ -265,119 +367,360 @@ juce::AudioProcessorEditor* CounterTuneIOAudioProcessor::createEditor()
 
 void CounterTuneIOAudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
+    PluginState state;
+    state.flags = keyConstraintEnabled.load() ? PluginState::keyConstraint : 0u;
+    state.fallbackBpm = fallbackTempo.load();
+    state.phraseLength = phraseLength;
+    state.seed = randomSeed.load();
+    state.detectedKey = detectedKey.load();
+    state.sampleSlot = samplePlayer.getSlot();
+
+    for (int s = 0; s < maxPitchSources; ++s)
+    {
+        state.downmixMode[s] = static_cast<juce::int32>(inputDownmix[static_cast<size_t>(s)].getMode());
+        state.downmixChannel[s] = inputDownmix[static_cast<size_t>(s)].getSelectedChannel();
+    }
 
+    std::fill(std::begin(state.capturedPhrase), std::end(state.capturedPhrase), static_cast<juce::int8>(-2));
+    std::fill(std::begin(state.generatedPhrase), std::end(state.generatedPhrase), static_cast<juce::int8>(-2));
+    std::array<int, phraseLength> phrase;
+    const int capturedLength = capturedMelody.read(phrase.data(), phraseLength);
+    for (int i = 0; i < capturedLength; ++i)
+        state.capturedPhrase[i] = static_cast<juce::int8>(phrase[static_cast<size_t>(i)]);
+    const int generatedLength = generatedMelody.read(phrase.data(), phraseLength);
+    for (int i = 0; i < generatedLength; ++i)
+        state.generatedPhrase[i] = static_cast<juce::int8>(phrase[static_cast<size_t>(i)]);
+
+    state.writeTo(destData);
+
+    // the performance numbers ride along for hosts and tools, setStateInformation skips them
+    juce::MemoryOutputStream out(destData, true);
+    metrics.createXml()->writeTo(out, juce::XmlElement::TextFormat().singleLine());
 }
 
 void CounterTuneIOAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
+    PluginState state;
+    if (!PluginState::readFrom(data, sizeInBytes, state))
+    {
+        DBG("Ignoring state that isn't ours");
+        return;
+    }
 
-}
+    setKeyConstraint((state.flags & PluginState::keyConstraint) != 0);
+    setFallbackTempo(state.fallbackBpm);
+    setRandomSeed(state.seed);
+    setSampleSlot(state.sampleSlot);
 
+    for (int s = 0; s < maxPitchSources; ++s)
+    {
+        const auto mode = juce::jlimit(0, static_cast<int>(InputDownmix::Mode::channel), static_cast<int>(state.downmixMode[s]));
+        setInputDownmix(static_cast<InputDownmix::Mode>(mode), state.downmixChannel[s], s);
+    }
+
+    // the tracker belongs to the generation thread, it picks the key up with the next phrase
+    const int key = juce::jlimit(-1, 23, static_cast<int>(state.detectedKey));
+    detectedKey.store(key);
+    restoredKey.store(key);
 
+    // phrases of another length don't line up with the clock, those stay out
+    if (state.phraseLength != phraseLength)
+        return;
 
-void CounterTuneIOAudioProcessor::playTestFile()
+    std::array<int, 2 * phraseLength> phrases;
+    for (int i = 0; i < phraseLength; ++i)
+    {
+        phrases[static_cast<size_t>(i)] = juce::jlimit(-2, 127, static_cast<int>(state.capturedPhrase[i]));
+        phrases[static_cast<size_t>(phraseLength + i)] = juce::jlimit(-2, 127, static_cast<int>(state.generatedPhrase[i]));
+    }
+    restoredPhrases.publish(phrases.data(), 2 * phraseLength);
+}
+
+void CounterTuneIOAudioProcessor::applyRestoredPhrases()
 {
-    DBG("Playing the audio file");
+    appliedRestoreVersion = restoredPhrases.getVersion();
+    restoredPhrases.read(restoreScratch.data(), static_cast<int>(restoreScratch.size()));
+    capturedMelody.publish(restoreScratch.data(), phraseLength);
+    generatedMelody.publish(restoreScratch.data() + phraseLength, phraseLength);
+}
 
-    // Stop any current playback
-    transportSource->stop();
-    transportSource->setSource(nullptr);
-    readerSource.reset();
+void CounterTuneIOAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
 
-    // Load from binary data
-    if (BinaryData::test_note_71_wav != nullptr && BinaryData::test_note_71_wavSize > 0)
-    {
-        // Create a memory stream from the binary data
-        std::unique_ptr<juce::InputStream> inputStream(new juce::MemoryInputStream(BinaryData::test_note_71_wav, BinaryData::test_note_71_wavSize, false));
-        juce::AudioFormatReader* reader = formatManager->createReaderFor(std::move(inputStream));
+    // the quality ladder reacts to inference time, offline it would make results machine dependent
+    pitchDetector->setAdaptiveQuality(!isNonRealtime);
 
-        if (reader != nullptr)
-        {
-            // Log the sample rate of the test audio file
-            DBG("Test note sample rate: " + juce::String(reader->sampleRate));
-
-            // Set up the reader source and transport
-            readerSource.reset(new juce::AudioFormatReaderSource(reader, true));
-            transportSource->setSource(readerSource.get(), 0, nullptr, reader->sampleRate);
-            transportSource->setPosition(0); // Start from the beginning
-            transportSource->start(); // Play
-            DBG("Transport started");
-        }
-        else
+    // Offline, processBlock analyses and generates itself. Waiting for the worker threads to finish
+    // what they're on means they can't be in the detector or the generator alongside it, and they
+    // check the mode again before they start anything new.
+    if (isNonRealtime)
+    {
         {
-            DBG("Couldnt create reader from binary data");
+            // every sample the audio thread counted is analysed, in order, so the detector's
+            // timeline stays the one processBlock places its slots on. nothing is skipped
+            const RealtimeGuard::CheckedCriticalSection::ScopedLockType lock(pitchWorkLock);
+            if (pitchThread && pitchDetectorReady.load())
+            {
+                // this runs inference on the host's thread and we're noexcept, a failure costs
+                // the pending frames and nothing else
+                try
+                {
+                    pitchThread->analysePending();
+                }
+                catch (const std::exception& e)
+                {
+                    DBG("Pitch analysis error switching to offline: " + juce::String(e.what()));
+                }
+                catch (...)
+                {
+                    DBG("Unknown pitch analysis error switching to offline");
+                }
+            }
         }
+
+        const RealtimeGuard::CheckedCriticalSection::ScopedLockType lock(generationWorkLock);
+        // a request the thread hasn't picked up won't be answered now, the next phrase asks again
+        if (generationRequested.exchange(false))
+            awaitingResponse.store(false);
     }
-    else
+}
+
+void CounterTuneIOAudioProcessor::setRandomSeed(juce::uint32 seed)
+{
+    randomSeed.store(seed);
+    melodyGenerator->setSeed(seed);
+}
+
+bool CounterTuneIOAudioProcessor::startSessionCapture(const juce::File& file)
+{
+    // the ring is allocated on the first start and is the biggest thing a capture adds
+    if (memoryBudget > 0 && sessionRecorder.getAllocatedBytes() == 0
+        && getMemoryReport().getInstanceBytes() + SessionCapture::Recorder::getRingBytes() > memoryBudget)
     {
-        DBG("Binary data not found");
+        DBG("Session capture refused, it would take the instance over its memory budget");
+        return false;
     }
+
+    SessionCapture::Header header;
+    header.sampleRate = getSampleRate();
+    // main bus only, the sidechains go through the buffer after it and the replay runs without them
+    header.numChannels = juce::jmax(1, getMainBusNumInputChannels());
+    header.maxBlockSize = getBlockSize();
+    header.downmixMode = getInputDownmixMode();
+    header.downmixChannel = getInputDownmixChannel();
+    header.keyConstraint = isKeyConstraintEnabled();
+    header.sampleSlot = getSampleSlot();
+    header.fallbackBpm = getFallbackTempo();
+
+    // a fresh seed, the generator has drawn who knows how many numbers from the old one by now
+    header.seed = static_cast<juce::uint32>(juce::Random::getSystemRandom().nextInt());
+    setRandomSeed(header.seed);
+    // the replay starts without a key either
+    keyTrackerResetRequested.store(true);
+
+    return sessionRecorder.start(file, header);
 }
 
 
-void CounterTuneIOAudioProcessor::initializeAudioPlayback()
+
+
+
+
+
+
+
+
+
+
+void CounterTuneIOAudioProcessor::initializePitchDetector()
 {
-    formatManager = std::make_unique<juce::AudioFormatManager>();
-    formatManager->registerBasicFormats();
+    if (!pitchDetector->initialize(BinaryData::crepe_small_onnx, BinaryData::crepe_small_onnxSize))
+    {
+        DBG("Failed to initialize CREPE model");
+        pitchDetectorReady.store(false);
+        return;
+    }
+
+    // the processor may be going away already, every step below is a chunk of ORT work
+    if (juce::Thread::currentThreadShouldExit())
+        return;
+
+#if COUNTERTUNE_HAS_CREPE_TINY
+    // under a budget it only stays if it fits, see enforceMemoryBudget
+    if (!pitchDetector->initializeTinyModel(BinaryData::crepe_tiny_onnx, BinaryData::crepe_tiny_onnxSize))
+    {
+        DBG("Failed to initialize CREPE tiny model, quality ladder skips that tier");
+    }
+#endif
+
+    if (juce::Thread::currentThreadShouldExit())
+        return;
+
+    pitchDetector->warmUp();
+    if (juce::Thread::currentThreadShouldExit())
+        return;
+
+    enforceMemoryBudget();
+    pitchDetectorReady.store(true);
+    DBG("CREPE model loaded successfully");
+}
+
+void CounterTuneIOAudioProcessor::initializeMelodyGenerator()
+{
+    if (!melodyGenerator->initialize(BinaryData::melody_model_onnx, BinaryData::melody_model_onnxSize))
+    {
+        DBG("Failed to initialize melody model");
+        generatorReady.store(false);
+        return;
+    }
+
+    if (juce::Thread::currentThreadShouldExit())
+        return;
 
-    transportSource = std::make_unique<juce::AudioTransportSource>();
-    resamplingSource = std::make_unique<juce::ResamplingAudioSource>(transportSource.get(), false, 2); // Stereo output
+    melodyGenerator->warmUp();
+    if (juce::Thread::currentThreadShouldExit())
+        return;
+
+    enforceMemoryBudget();
+    generatorReady.store(true);
+    DBG("Melody model loaded successfully");
 }
 
+void CounterTuneIOAudioProcessor::enforceMemoryBudget()
+{
+    if (memoryBudget == 0)
+        return;
 
+    // the second CREPE session is the one optional piece, the ladder steps from full to DSP without it
+    if (pitchDetector->hasTinyModel() && getMemoryReport().getInstanceBytes() > memoryBudget)
+    {
+        pitchDetector->releaseTinyModel();
+        DBG("CREPE tiny model dropped, the instance doesn't fit its memory budget with it");
+    }
 
+    const auto report = getMemoryReport();
+    memoryBudgetExceeded.store(report.getInstanceBytes() > memoryBudget);
+    if (memoryBudgetExceeded.load())
+        DBG("Over the memory budget of " + MemoryAccounting::formatBytes(memoryBudget) + ":\n" + report.toString());
+}
 
+void CounterTuneIOAudioProcessor::setDefaultMemoryBudget(size_t bytes)
+{
+    defaultMemoryBudget.store(static_cast<juce::int64>(bytes));
+}
 
+size_t CounterTuneIOAudioProcessor::resolveMemoryBudget()
+{
+    const auto programmatic = defaultMemoryBudget.load();
+    if (programmatic >= 0)
+        return static_cast<size_t>(programmatic);
 
+    const auto fromEnvironment = juce::SystemStats::getEnvironmentVariable("COUNTERTUNE_MEMORY_BUDGET_MB", {});
+    const juce::int64 megabytes = fromEnvironment.isNotEmpty() ? fromEnvironment.getLargeIntValue() : COUNTERTUNE_MEMORY_BUDGET_MB;
+    return static_cast<size_t>(juce::jmax<juce::int64>(0, megabytes)) * 1024 * 1024;
+}
 
+MemoryAccounting::Report CounterTuneIOAudioProcessor::getMemoryReport() const
+{
+    MemoryAccounting::Report report;
+    pitchDetector->addMemoryUsage(report);
+    melodyGenerator->addMemoryUsage(report);
+    report.add("pitch handoff", PitchDetectionThread::getAllocatedBytes());
+    samplePlayer.addMemoryUsage(report);
+    report.add("session capture", sessionRecorder.getAllocatedBytes());
+
+    // in the plugin binary, mapped once however many instances there are
+    report.add("crepe model data", static_cast<size_t>(BinaryData::crepe_small_onnxSize), true);
+#if COUNTERTUNE_HAS_CREPE_TINY
+    report.add("crepe tiny model data", static_cast<size_t>(BinaryData::crepe_tiny_onnxSize), true);
+#endif
+    report.add("melody model data", static_cast<size_t>(BinaryData::melody_model_onnxSize), true);
+    return report;
+}
 
+CounterTuneIOAudioProcessor::PitchDetectionThread::PitchDetectionThread(CounterTuneIOAudioProcessor& processor, PitchDetector& detector)
+    : juce::Thread("Pitch Detection Thread"), owner(processor), pitchDetector(detector) {}
 
 void CounterTuneIOAudioProcessor::PitchDetectionThread::run() {
-    while (!threadShouldExit()) {
-        juce::AudioBuffer<float> processingBuffer;
+    CT_TRACE_THREAD("Pitch Detection");
 
-        {
-            juce::ScopedLock lock(bufferLock);
-            if (writePosition > 0) {
-                // Copy accumulated data for processing
-                processingBuffer.setSize(accumulatedBuffer.getNumChannels(), writePosition);
-                for (int ch = 0; ch < accumulatedBuffer.getNumChannels(); ++ch) {
-                    processingBuffer.copyFrom(ch, 0, accumulatedBuffer, ch, 0, writePosition);
-                }
-                writePosition = 0; // Reset write position
-            }
-        }
+    // Load and warm up off the message thread, audio that arrives meanwhile just accumulates
+    owner.initializePitchDetector();
 
-        // Process outside the lock to avoid blocking audio thread
-        if (processingBuffer.getNumSamples() > 0) {
-            pitchDetector.processBuffer(processingBuffer);
+    while (!threadShouldExit()) {
+        {
+            // offline processBlock analyses itself, setNonRealtime took over whatever was left here
+            const RealtimeGuard::CheckedCriticalSection::ScopedLockType lock(owner.pitchWorkLock);
+            if (!owner.isNonRealtime())
+                analysePending();
         }
 
         wait(10);
     }
 }
 
-void CounterTuneIOAudioProcessor::PitchDetectionThread::processAudio(const juce::AudioBuffer<float>& buffer) {
-    juce::ScopedLock lock(bufferLock);
+void CounterTuneIOAudioProcessor::PitchDetectionThread::analysePending() {
+    int numSamples = 0;
 
-    // Initialize accumulated buffer if needed
-    if (accumulatedBuffer.getNumChannels() != buffer.getNumChannels()) {
-        accumulatedBuffer.setSize(buffer.getNumChannels(), 8192); // Reasonable size
-        writePosition = 0;
+    {
+        CT_TRACE_SCOPE("ringDrain");
+        // read before draining so the chunk can't be older than this, at worst it's a block newer
+        owner.pitchChunkArrivalTicks = lastHandoffTicks.load(std::memory_order_acquire);
+        int start1, size1, start2, size2;
+        handoffFifo.prepareToRead(handoffFifo.getNumReady(), start1, size1, start2, size2);
+        numSamples = size1 + size2;
+
+        if (numSamples > 0) {
+            // never grows, the processing buffer was allocated at full handoff capacity
+            const int numSources = owner.numPitchSources.load();
+            processingBuffer.setSize(numSources, numSamples, false, false, true);
+            for (int s = 0; s < numSources; ++s) {
+                processingBuffer.copyFrom(s, 0, handoffBuffer, s, start1, size1);
+                if (size2 > 0)
+                    processingBuffer.copyFrom(s, size1, handoffBuffer, s, start2, size2);
+            }
+        }
+        handoffFifo.finishedRead(numSamples);
     }
 
-    // Check if we have enough space
-    int samplesNeeded = buffer.getNumSamples();
-    if (writePosition + samplesNeeded > accumulatedBuffer.getNumSamples()) {
-        // If not enough space, process what we have and start fresh
-        writePosition = 0;
+    if (numSamples > 0) {
+        owner.pitchChunkEndSample = pitchDetector.getSamplesReceived() + numSamples;
+        pitchDetector.processBuffer(processingBuffer);
     }
+}
 
-    // Append new samples
-    for (int ch = 0; ch < buffer.getNumChannels(); ++ch) {
-        accumulatedBuffer.copyFrom(ch, writePosition, buffer, ch, 0, samplesNeeded);
+void CounterTuneIOAudioProcessor::MelodyGenerationThread::run() {
+    CT_TRACE_THREAD("Melody Generation");
+
+    owner.initializeMelodyGenerator();
+
+    // Polled rather than notified, so the audio thread never touches a lock to request a phrase
+    while (!threadShouldExit()) {
+        {
+            const RealtimeGuard::CheckedCriticalSection::ScopedLockType lock(owner.generationWorkLock);
+            if (!owner.isNonRealtime() && owner.generationRequested.exchange(false))
+                owner.generateCounterMelody();
+        }
+
+        wait(5);
     }
-    writePosition += samplesNeeded;
+}
+
+int CounterTuneIOAudioProcessor::PitchDetectionThread::processAudio(const juce::AudioBuffer<float>& buffer) {
+    // If the pitch thread fell behind, whatever doesn't fit is dropped rather than waited for
+    int start1, size1, start2, size2;
+    handoffFifo.prepareToWrite(buffer.getNumSamples(), start1, size1, start2, size2);
+
+    if (size1 > 0)
+        owner.downmixPitchSources(buffer, 0, size1, handoffBuffer, start1);
+    if (size2 > 0)
+        owner.downmixPitchSources(buffer, size1, size2, handoffBuffer, start2);
+    handoffFifo.finishedWrite(size1 + size2);
+    lastHandoffTicks.store(juce::Time::getHighResolutionTicks(), std::memory_order_release);
+
+    owner.metrics.addDroppedSamples(buffer.getNumSamples() - (size1 + size2));
+    return size1 + size2;
 }
 
 
@@ -386,28 +729,131 @@ void CounterTuneIOAudioProcessor::PitchDetectionThread::processAudio(const juce:
 
 
 
-float CounterTuneIOAudioProcessor::getCurrentFrequency() const {
-    return pitchDetector ? pitchDetector->getCurrentFrequency() : 0.0f;
+float CounterTuneIOAudioProcessor::getCurrentFrequency(int source) const {
+    return pitchDetector ? pitchDetector->getCurrentFrequency(source) : 0.0f;
 }
 
-float CounterTuneIOAudioProcessor::getCurrentConfidence() const {
-    return pitchDetector ? pitchDetector->getCurrentConfidence() : 0.0f;
+float CounterTuneIOAudioProcessor::getCurrentConfidence(int source) const {
+    return pitchDetector ? pitchDetector->getCurrentConfidence(source) : 0.0f;
 }
 
+QualityController::Tier CounterTuneIOAudioProcessor::getPitchQualityTier() const {
+    return pitchDetector ? pitchDetector->getQualityTier() : QualityController::Tier::full;
+}
 
-//std::vector<int> CounterTuneIOAudioProcessor::getCapturedMelodySnapshot() const {
-//    juce::ScopedLock lock(capturedMelodyLock);
-//    return capturedMelody;
-//}
 
+bool CounterTuneIOAudioProcessor::dumpTrace(const juce::File& file) const {
+    return Trace::dumpChromeJson(file);
+}
 
+bool CounterTuneIOAudioProcessor::hotSwapPitchModel(const juce::File& modelFile) {
+    juce::MemoryBlock modelData;
+    if (!modelFile.loadFileAsData(modelData)) return false;
 
-int CounterTuneIOAudioProcessor::frequencyToMidiNote(float frequency) const {
-    if (frequency <= 0) return -1;
-    float midiNote = 69.0f + 12.0f * (std::log(frequency / 440.0f) / std::log(2.0f));
-    return static_cast<int>(std::round(midiNote));
+    pitchDetector->hotSwapModel(modelData.getData(), modelData.getSize(), false, [](bool swapped) {
+        DBG(swapped ? "CREPE model hot swap done" : "CREPE model hot swap failed, keeping the current model");
+    });
+    return true;
 }
 
+bool CounterTuneIOAudioProcessor::hotSwapMelodyModel(const juce::File& modelFile) {
+    juce::MemoryBlock modelData;
+    if (!modelFile.loadFileAsData(modelData)) return false;
+
+    melodyGenerator->hotSwapModel(modelData.getData(), modelData.getSize(), [this](bool swapped) {
+        DBG(swapped ? "Melody model hot swap done" : "Melody model hot swap failed: " + melodyGenerator->getLastError());
+    });
+    return true;
+}
+
+
+
+
+
+void CounterTuneIOAudioProcessor::generateCounterMelody()
+{
+    if (!generatorReady.load())
+        return;
+
+    auto events = capturedMelody.snapshot();
+    const bool hasNotes = std::any_of(events.begin(), events.end(), [](int event) { return event >= 0; });
+
+    std::vector<int> counterMelody;
+    if (hasNotes)
+    {
+        updateKeyConstraint(events);
+        counterMelody = melodyGenerator->generateMelody(events);
+    }
+    else
+    {
+        // nothing sung, answer with silence instead of inventing a line
+        counterMelody.assign(phraseLength, -2);
+        counterMelody[0] = -1;
+    }
+
+    if (!counterMelody.empty())
+    {
+        publishGeneratedMelody(counterMelody);
+        metrics.generationLatency.record(juce::Time::highResolutionTicksToSeconds(
+            juce::Time::getHighResolutionTicks() - generationRequestTicks.load()));
+    }
+
+    awaitingResponse.store(false);
+}
+
+void CounterTuneIOAudioProcessor::updateKeyConstraint(const std::vector<int>& phrase)
+{
+    if (keyTrackerResetRequested.exchange(false))
+        keyTracker.reset();
+
+    // a restored key counts as enough singing to trust it, the new phrase goes on top
+    const int primedKey = restoredKey.exchange(-2);
+    if (primedKey >= -1)
+    {
+        keyTracker.reset();
+        if (primedKey >= 0)
+        {
+            KeyTracker::Key key;
+            key.tonic = primedKey % 12;
+            key.minor = primedKey >= 12;
+            keyTracker.prime(key, minKeyWeight);
+        }
+    }
+
+    // every note weighted by how many slots it lasts
+    for (size_t i = 0; i < phrase.size(); ++i)
+    {
+        if (phrase[i] < 0)
+            continue;
+        size_t end = i + 1;
+        while (end < phrase.size() && phrase[end] == -2)
+            ++end;
+        keyTracker.addNote(phrase[i], static_cast<float>(end - i));
+    }
+
+    const auto key = keyTracker.getKey();
+    const bool known = keyTracker.getTotalWeight() >= minKeyWeight && key.correlation >= minKeyCorrelation;
+    detectedKey.store(known ? key.tonic + (key.minor ? 12 : 0) : -1);
+
+    if (known && keyConstraintEnabled.load())
+        melodyGenerator->setPitchClassBias(KeyTracker::makePitchClassBias(key, outOfKeyPenalty));
+    else
+        melodyGenerator->clearPitchClassBias();
+}
+
+juce::String CounterTuneIOAudioProcessor::getDetectedKeyName() const
+{
+    const int key = detectedKey.load();
+    if (key < 0)
+        return {};
+
+    KeyTracker::Key k;
+    k.tonic = key % 12;
+    k.minor = key >= 12;
+    return KeyTracker::getKeyName(k);
+}
+
+
 
 
 
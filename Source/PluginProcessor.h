@@ -3,6 +3,19 @@
 #include <JuceHeader.h>
 #include "PitchDetector.h"
 #include "MelodyGenerator.h"
+#include "PhraseClock.h"
+#include "PhraseBuffer.h"
+#include "MidiScheduler.h"
+#include "MelodyCapture.h"
+#include "Trace.h"
+#include "RealtimeGuard.h"
+#include "PerformanceMetrics.h"
+#include "SessionCapture.h"
+#include "InputDownmix.h"
+#include "KeyTracker.h"
+#include "SamplePlayer.h"
+#include "MemoryAccounting.h"
+#include "PluginState.h"
 
 class CounterTuneIOAudioProcessor : public juce::AudioProcessor
 {
@@ -31,104 +44,241 @@ public:
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
+    // Hosts switch this on for offline bounces, the replay tool for deterministic runs. Pitch
+    // analysis and counter-melody generation then happen inside processBlock instead of on their
+    // threads, so the output only depends on the audio, the transport and the seed.
+    // Switching on blocks the caller for one pitch-thread work unit: the samples already queued are
+    // analysed on the calling thread, or the thread's current batch is waited for.
+    void setNonRealtime(bool isNonRealtime) noexcept override;
+
     // Method to play the audio file
-    void playTestFile();
+    void playTestFile() { samplePlayer.playTestNote(); }
+
+    // sample slot A-E (0-4) the counter-melody plays through, SamplePlayer::noSlot for MIDI only
+    void setSampleSlot(int slot) { samplePlayer.setSlot(slot); }
+    int getSampleSlot() const { return samplePlayer.getSlot(); }
 
     // public crepe getters
     bool isPitchDetectorReady() const { return pitchDetectorReady.load(); }
-    float getCurrentFrequency() const;
-    float getCurrentConfidence() const;
+    // source 0 is the main input, 1 and up the sidechains. only source 0 feeds the melody capture
+    float getCurrentFrequency(int source = 0) const;
+    float getCurrentConfidence(int source = 0) const;
+    int getNumPitchSources() const { return numPitchSources.load(); }
+    // bumps with every analysed frame, the UI only has to look at the pitch values when it moved
+    juce::uint32 getPitchVersion() const { return pitchVersion.load(std::memory_order_relaxed); }
+    QualityController::Tier getPitchQualityTier() const;
+
+    // which part of a source's bus the pitch path listens to, safe to change while playing
+    void setInputDownmix(InputDownmix::Mode mode, int channel = 0, int source = 0) { inputDownmix[static_cast<size_t>(juce::jlimit(0, maxPitchSources - 1, source))].setMode(mode, channel); }
+    InputDownmix::Mode getInputDownmixMode(int source = 0) const { return inputDownmix[static_cast<size_t>(juce::jlimit(0, maxPitchSources - 1, source))].getMode(); }
+    int getInputDownmixChannel(int source = 0) const { return inputDownmix[static_cast<size_t>(juce::jlimit(0, maxPitchSources - 1, source))].getSelectedChannel(); }
 
     // public generator getters
     bool isGeneratorReady() const { return generatorReady.load(); }
 
-    // melody access
-    const std::vector<int>& getCapturedMelody() const { return capturedMelody; };
-    const std::vector<int>& getGeneratedMelody() const { return generatedMelody; };
+    // writes every trace scope recorded so far as Chrome trace JSON, only has content
+    // in builds with COUNTERTUNE_ENABLE_TRACING
+    bool dumpTrace(const juce::File& file) const;
 
-//    std::vector<int> getCapturedMelodySnapshot() const;
+    // swap a model in a running instance, loading and warm-up happen in the background
+    bool hotSwapPitchModel(const juce::File& modelFile);
+    bool hotSwapMelodyModel(const juce::File& modelFile);
+
+    // load meter and latency histograms, safe to read from any thread
+    const PerformanceMetrics& getPerformanceMetrics() const { return metrics; }
+
+    // melody access
+    std::vector<int> getCapturedMelody() const { return capturedMelody.snapshot(); };
+    std::vector<int> getGeneratedMelody() const { return generatedMelody.snapshot(); };
+    juce::uint32 getCapturedMelodyVersion() const { return capturedMelody.getVersion(); }
+    juce::uint32 getGeneratedMelodyVersion() const { return generatedMelody.getVersion(); }
+    // copy into dest without allocating, returns the length
+    int readCapturedMelody(int* dest, int capacity) const { return capturedMelody.read(dest, capacity); }
+    int readGeneratedMelody(int* dest, int capacity) const { return generatedMelody.read(dest, capacity); }
+
+    // keeps counter-melodies in the key the captured phrases suggest, on by default
+    void setKeyConstraint(bool enabled) { keyConstraintEnabled.store(enabled); }
+    bool isKeyConstraintEnabled() const { return keyConstraintEnabled.load(); }
+    // empty until enough has been sung to tell
+    juce::String getDetectedKeyName() const;
+
+    // tempo the phrase clock runs at when the host doesn't report one, any thread. NaN and
+    // infinity are ignored, jlimit would let a NaN straight through
+    void setFallbackTempo(double bpm) { if (std::isfinite(bpm)) fallbackTempo.store(juce::jlimit(20.0, 400.0, bpm)); }
+    double getFallbackTempo() const { return fallbackTempo.load(); }
+
+    // seed of the counter-melody sampling, picked at random on construction
+    void setRandomSeed(juce::uint32 seed);
+    juce::uint32 getRandomSeed() const { return randomSeed.load(); }
+
+    // Records what the pitch path sees plus the transport into a capture for CounterTuneReplay.
+    // Starting reseeds the sampling and stores the seed with the capture.
+    bool startSessionCapture(const juce::File& file);
+    void stopSessionCapture() { sessionRecorder.stop(); }
+    bool isCapturingSession() const { return sessionRecorder.isRecording(); }
+
+    // every analysed frame, on the pitch thread or in processBlock when non-realtime. set before audio starts
+    void setPitchFrameListener(std::function<void(const PitchDetector::Frame&)> listener) { pitchFrameListener = std::move(listener); }
+
+    // What this instance holds component by component, plus the embedded models every instance
+    // shares. Safe from any thread but allocates, so not from the audio thread.
+    MemoryAccounting::Report getMemoryReport() const;
+
+    // Budget mode, for templates with many instances. With a budget the models load without ORT's
+    // arena, the sidechain batch buffers are skipped, and long-form scratch and decoded samples
+    // aren't kept. The tiny CREPE tier only stays loaded while the instance fits the budget with
+    // it, and a session capture that would go over is refused. An instance that's over anyway
+    // once its models are in is reported (isOverMemoryBudget, the editor's memory line). Fixed
+    // when the instance is created: setDefaultMemoryBudget, else COUNTERTUNE_MEMORY_BUDGET_MB
+    // from the environment, else the build's default. 0 = no budget.
+    static void setDefaultMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const { return memoryBudget; }
+    bool isOverMemoryBudget() const { return memoryBudgetExceeded.load(); }
 
 private:
 
 
-    // Audio playback for testing _________________________________________________________________________________________________________
-    std::unique_ptr<juce::AudioFormatManager> formatManager;
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-    std::unique_ptr<juce::AudioTransportSource> transportSource;
-    std::unique_ptr<juce::ResamplingAudioSource> resamplingSource;
-    void initializeAudioPlayback();
+    // in bytes, 0 = none. resolved before any member below allocates
+    const size_t memoryBudget = resolveMemoryBudget();
+    static size_t resolveMemoryBudget();
+    std::atomic<bool> memoryBudgetExceeded{ false };
+    // after each model is in, from the thread that loaded it
+    void enforceMemoryBudget();
+
+
+    // Sample playback ____________________________________________________________________________________________________________________
+    // the test note into the pitch path and the counter-melody out of the selected slot
+    SamplePlayer samplePlayer;
 
 
     // timing
     bool active = false;
-    float bpm = 140.0f;
-    double captureCounter = 0.0;
-    double samplesPerSymbol = 0.0;
-//    double totalSamples = 0.0;
-//    double nextSymbolTime = 0.0;
-    void updateSamplesPerSymbol() { if (active) samplesPerSymbol = 60.0 / bpm * getSampleRate() / 4.0 * 8.0 / 8.0; }
+    static constexpr int phraseLength = 32;
+    static constexpr double fallbackBpm = 140.0;  // used when the host doesn't report a tempo
+    std::atomic<double> fallbackTempo{ fallbackBpm };
+    PhraseClock phraseClock;
     std::atomic<bool> awaitingResponse{ false };
     bool shouldResetCapturedMelody = false;
-    bool shouldResetTimekeeping = true;
-    bool inputNoteActive = false;
-    int testInt = 0;
+
+    PerformanceMetrics metrics;
+    SessionCapture::Recorder sessionRecorder;
+    std::atomic<juce::uint32> randomSeed{ 0 };
 
 
 
     // Pitch detection ____________________________________________________________________________________________________________________
     std::unique_ptr<PitchDetector> pitchDetector;
+
+    // The main input and every enabled sidechain bus is a pitch source. Each is downmixed to one
+    // channel on the audio thread, all of them share the detector and go through CREPE as one batch.
+    static constexpr int maxPitchSources = PitchDetector::maxStreams;
+    struct PitchSource {
+        int firstChannel = 0;  // in the processBlock buffer
+        int numChannels = 0;   // 0 while the bus is off
+    };
+    std::array<PitchSource, maxPitchSources> pitchSources{};  // set up in prepareToPlay
+    std::atomic<int> numPitchSources{ 1 };  // up to the last enabled sidechain
+    std::array<InputDownmix, maxPitchSources> inputDownmix;
+    juce::AudioBuffer<float> sourceBuffer;  // non-realtime only, sized in prepareToPlay
+    void updatePitchSources();
+    void downmixPitchSources(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                             juce::AudioBuffer<float>& dest, int destStartSample) const noexcept;
     class PitchDetectionThread : public juce::Thread {
     public:
-        PitchDetectionThread(PitchDetector& detector)
-            : juce::Thread("Pitch Detection Thread"), pitchDetector(detector) {}
+        PitchDetectionThread(CounterTuneIOAudioProcessor& processor, PitchDetector& detector);
         void run() override;
-        void processAudio(const juce::AudioBuffer<float>& buffer);
+        // audio thread, lock-free. sources are downmixed straight into the handoff, one channel each.
+        // returns how many samples made it in
+        int processAudio(const juce::AudioBuffer<float>& buffer);
+        // drains the handoff into the detector, only with the owner's pitchWorkLock held
+        void analysePending();
+        // handoff plus processing buffer, both allocated at full capacity up front
+        static constexpr size_t getAllocatedBytes() { return 2 * maxPitchSources * handoffCapacity * sizeof(float); }
     private:
+        static constexpr int handoffCapacity = 16384;  // ~340 ms at 48 kHz between two drains
+
+        CounterTuneIOAudioProcessor& owner;
         PitchDetector& pitchDetector;
-        juce::AudioBuffer<float> accumulatedBuffer;  // Changed name
-        juce::CriticalSection bufferLock;
-        int writePosition = 0;  // Track where to write next
+        juce::AbstractFifo handoffFifo{ handoffCapacity };
+        juce::AudioBuffer<float> handoffBuffer{ maxPitchSources, handoffCapacity };
+        juce::AudioBuffer<float> processingBuffer{ maxPitchSources, handoffCapacity };
+        std::atomic<juce::int64> lastHandoffTicks{ 0 };  // when the audio thread last wrote
     };
     std::unique_ptr<PitchDetectionThread> pitchThread;
+    // held by the pitch thread while it drains and analyses, setNonRealtime takes it to analyse
+    // what's left in the handoff itself, so processBlock never runs the detector alongside the
+    // thread and no handed-over sample is left out of the detector's timeline
+    RealtimeGuard::CheckedCriticalSection pitchWorkLock;
     std::atomic<bool> pitchDetectorReady{ false };
+    std::function<void(const PitchDetector::Frame&)> pitchFrameListener;
+    std::atomic<juce::uint32> pitchVersion{ 0 };
+    void initializePitchDetector();
+    // pitch thread: when the chunk being analysed arrived and where it ends, for the end-to-end latency
+    juce::int64 pitchChunkArrivalTicks = 0;
+    juce::int64 pitchChunkEndSample = 0;
 
     // Melody capture _____________________________________________________________________________________________________________________
-    std::vector<int> capturedMelody
-    {
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2
-    };
-    int frequencyToMidiNote(float frequency) const;
-    juce::CriticalSection capturedMelodyLock;
+    // segmented on the pitch thread, quantized to sixteenths on the audio thread
+    MelodyCapture melodyCapture{ phraseLength };
+    // finished phrases, written by the audio thread and read lock-free by the UI and the generator
+    PhraseBuffer<phraseLength> capturedMelody{ phraseLength, -2 };
     int capturePosition = 0;
 
+    // Phrases from setStateInformation, captured then generated. Published by the message thread
+    // and taken over by the audio thread once no generation is in flight, so each phrase buffer
+    // keeps its single writer.
+    PhraseBuffer<2 * phraseLength> restoredPhrases{ 2 * phraseLength, -2 };
+    juce::uint32 appliedRestoreVersion = 0;
+    std::array<int, 2 * phraseLength> restoreScratch{};
+    void applyRestoredPhrases();
+    static_assert(phraseLength <= PluginState::maxPhraseLength, "phrases have to fit the saved state");
+    // samples handed to the pitch path so far, the timeline its frames and onsets are on. equal to
+    // the detector's own count once everything handed over is analysed. dropped samples never
+    // reach the detector, so they don't count here either
+    juce::int64 pitchTimelineSample = 0;
+
 
     // Melody generation __________________________________________________________________________________________________________________
-    std::vector<int> generatedMelody
-    {
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2,
-        -2, -2, -2, -2
-    };
+    // written by the generation thread, read lock-free by the audio thread at phrase starts
+    PhraseBuffer<phraseLength> generatedMelody{ phraseLength, -2 };
     std::unique_ptr<MelodyGenerator> melodyGenerator;
-
-
-    //class MelodyGenerationThread : public juce::Thread {
-    // ...
-    //};
+    void publishGeneratedMelody(const std::vector<int>& events) { generatedMelody.publish(events); }
+
+    // Key of the session so far, fed one captured phrase per generation and turned into the
+    // generator's pitch class bias. Only touched by whoever runs generateCounterMelody.
+    KeyTracker keyTracker;
+    static constexpr float minKeyWeight = 8.0f;         // slots of notes before the key is trusted
+    static constexpr float minKeyCorrelation = 0.5f;
+    static constexpr float outOfKeyPenalty = -4.0f;     // log-prob, ~1/55 of the model's odds
+    std::atomic<bool> keyConstraintEnabled{ true };
+    std::atomic<bool> keyTrackerResetRequested{ false };
+    std::atomic<int> restoredKey{ -2 };  // from setStateInformation, primes the tracker. -2 = nothing to do
+    std::atomic<int> detectedKey{ -1 };  // tonic + 12 for minor, -1 = none yet
+    void updateKeyConstraint(const std::vector<int>& phrase);
+
+    // MIDI output ________________________________________________________________________________________________________________________
+    MidiScheduler midiScheduler;
+    juce::MidiBuffer schedulerMidi;  // the counter-melody's events of this block, kept apart from the host's
+    std::array<int, phraseLength> scheduledPhrase{};  // audio thread copy of generatedMelody
+    void loadScheduledPhrase();
+
+
+    class MelodyGenerationThread : public juce::Thread {
+    public:
+        MelodyGenerationThread(CounterTuneIOAudioProcessor& processor)
+            : juce::Thread("Melody Generation Thread"), owner(processor) {}
+        void run() override;
+    private:
+        CounterTuneIOAudioProcessor& owner;
+    };
+    std::unique_ptr<MelodyGenerationThread> generatorThread;
 
     std::atomic<bool> generatorReady{ false };
+    std::atomic<bool> generationRequested{ false };  // set by the audio thread, polled by the generator
+    RealtimeGuard::CheckedCriticalSection generationWorkLock;  // same as pitchWorkLock, for generations
+    std::atomic<juce::int64> generationRequestTicks{ 0 };
+    void initializeMelodyGenerator();
+    void generateCounterMelody();
 
 
 
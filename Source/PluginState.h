@@ -0,0 +1,85 @@
+#pragma once
+#include <JuceHeader.h>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// What getStateInformation saves: settings, the last captured and generated phrase, the seed and the
+// detected key. One trivially copyable struct, so saving and loading are a single memcpy each way
+// and a reopened project has its counter-melody back without running the model.
+//
+// Layout is the struct as declared, native byte order (little-endian on everything we build for).
+// Fields are only ever appended. size says how much of the struct the writer knew about, a reader
+// takes that much over its defaults, so old states load in new builds and the other way around.
+//
+// getStateInformation appends the PerformanceMetrics XML (UTF-8) after the struct. It's an export
+// for hosts and tools, readFrom never looks past size and nothing is restored from it.
+struct PluginState {
+    static constexpr char magic[4] = { 'C', 'T', 'S', 'T' };
+    static constexpr juce::uint32 currentVersion = 1;
+    static constexpr int maxPhraseLength = 64;
+    static constexpr int maxSources = 4;
+
+    enum Flags : juce::uint32 {
+        keyConstraint = 1 << 0
+    };
+
+    char fileMagic[4] = { magic[0], magic[1], magic[2], magic[3] };
+    juce::uint32 version = currentVersion;
+    juce::uint32 size = sizeof(PluginState);
+    juce::uint32 flags = keyConstraint;
+
+    // clock
+    double fallbackBpm = 140.0;
+    juce::int32 phraseLength = 0;
+
+    // generator
+    juce::uint32 seed = 0;
+    juce::int32 detectedKey = -1;  // tonic + 12 for minor, -1 = none yet
+    juce::int32 sampleSlot = -1;
+
+    // detector, InputDownmix::Mode and channel per pitch source
+    juce::int32 downmixMode[maxSources] = { 2, 2, 2, 2 };
+    juce::int32 downmixChannel[maxSources] = {};
+
+    // phrases, -1 = note off, -2 = hold, 0-127 = note
+    juce::int8 capturedPhrase[maxPhraseLength] = {};
+    juce::int8 generatedPhrase[maxPhraseLength] = {};
+
+    void writeTo(juce::MemoryBlock& dest) const { dest.replaceAll(this, sizeof(PluginState)); }
+
+    // false for anything that isn't a state of ours, state keeps its defaults then
+    static bool readFrom(const void* data, int sizeInBytes, PluginState& state) {
+        const auto stored = storedSize(data, sizeInBytes);
+        if (stored == 0) return false;
+
+        std::memcpy(static_cast<void*>(&state), data, juce::jmin(stored, sizeof(PluginState)));
+        state.size = sizeof(PluginState);
+        return true;
+    }
+
+    // the metrics block after the struct, nullptr for states without one
+    static std::unique_ptr<juce::XmlElement> readMetrics(const void* data, int sizeInBytes) {
+        const auto stored = storedSize(data, sizeInBytes);
+        if (stored == 0 || stored >= static_cast<size_t>(sizeInBytes)) return nullptr;
+
+        const auto* text = static_cast<const char*>(data) + stored;
+        return juce::parseXML(juce::String::fromUTF8(text, sizeInBytes - static_cast<int>(stored)));
+    }
+
+private:
+    // how much of the struct the writer saved, 0 if it isn't a state of ours
+    static size_t storedSize(const void* data, int sizeInBytes) {
+        constexpr auto headerSize = offsetof(PluginState, flags);
+        if (data == nullptr || sizeInBytes < static_cast<int>(headerSize)) return 0;
+
+        PluginState header;
+        std::memcpy(static_cast<void*>(&header), data, headerSize);
+        if (std::memcmp(header.fileMagic, magic, sizeof(magic)) != 0 || header.size < headerSize
+            || header.size > static_cast<juce::uint32>(sizeInBytes))
+            return 0;
+        return header.size;
+    }
+};
+
+static_assert(std::is_trivially_copyable<PluginState>::value, "PluginState is saved and loaded with memcpy");
@@ -0,0 +1,105 @@
+#include "QualityController.h"
+#include <algorithm>
+
+QualityController::QualityController() {
+    for (auto& available : tierAvailable)
+        available.store(true);
+}
+
+void QualityController::setTierAvailable(Tier tier, bool available) {
+    // the full tier is always there, everything else falls back onto it
+    if (tier == Tier::full) return;
+    tierAvailable[static_cast<size_t>(tier)].store(available);
+}
+
+void QualityController::reset() {
+    load = 0.0;
+    smoothedLoad.store(0.0f, std::memory_order_relaxed);
+    overloadedFrames = 0;
+    headroomFrames = 0;
+    upgradeHoldFrames = framesToUpgrade;
+    framesSinceUpgrade = -1;
+    setTier(Tier::full);
+}
+
+bool QualityController::reportInference(double inferenceSeconds, double budgetSeconds) {
+    if (budgetSeconds <= 0.0) return false;
+
+    const double frameLoad = inferenceSeconds / budgetSeconds;
+    load += smoothing * (frameLoad - load);
+    smoothedLoad.store(static_cast<float>(load), std::memory_order_relaxed);
+
+    if (framesSinceUpgrade >= 0 && ++framesSinceUpgrade > 2 * upgradeHoldFrames) {
+        // the last upgrade held up, go back to the normal hold time
+        upgradeHoldFrames = framesToUpgrade;
+        framesSinceUpgrade = -1;
+    }
+
+    // A single frame over budget means we are already falling behind, don't wait for the average
+    if (load > downgradeLoad || frameLoad > 1.0) {
+        headroomFrames = 0;
+        if (++overloadedFrames >= framesToDowngrade || frameLoad > 1.0)
+            return stepDown();
+        return false;
+    }
+
+    overloadedFrames = 0;
+
+    if (load < upgradeLoad) {
+        if (++headroomFrames >= upgradeHoldFrames)
+            return stepUp();
+    }
+    else {
+        headroomFrames = 0;
+    }
+
+    return false;
+}
+
+bool QualityController::stepDown() {
+    if (framesSinceUpgrade >= 0) {
+        // fell straight back down after an upgrade, wait longer before trying again
+        upgradeHoldFrames = std::min(upgradeHoldFrames * 2, maxFramesToUpgrade);
+        framesSinceUpgrade = -1;
+    }
+
+    for (int t = static_cast<int>(getCurrentTier()) + 1; t < numTiers; ++t) {
+        if (tierAvailable[static_cast<size_t>(t)].load()) {
+            setTier(static_cast<Tier>(t));
+            return true;
+        }
+    }
+    overloadedFrames = 0;
+    return false;
+}
+
+bool QualityController::stepUp() {
+    for (int t = static_cast<int>(getCurrentTier()) - 1; t >= 0; --t) {
+        if (tierAvailable[static_cast<size_t>(t)].load()) {
+            setTier(static_cast<Tier>(t));
+            framesSinceUpgrade = 0;
+            return true;
+        }
+    }
+    headroomFrames = 0;
+    return false;
+}
+
+void QualityController::setTier(Tier tier) {
+    currentTier.store(tier, std::memory_order_relaxed);
+
+    // The next tier has a different cost, start measuring it from scratch
+    overloadedFrames = 0;
+    headroomFrames = 0;
+    load = 0.0;
+}
+
+const char* QualityController::getTierName(Tier tier) {
+    switch (tier) {
+    case Tier::full:         return "FULL";
+    case Tier::reducedRate:  return "REDUCED RATE";
+    case Tier::tinyModel:    return "TINY MODEL";
+    case Tier::dspEstimator: return "DSP";
+    }
+    return "";
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+// Tracks pitch inference cost against the real-time budget of one hop and walks a
+// quality ladder: larger hop -> CREPE tiny -> DSP estimator. Stepping down happens as
+// soon as the smoothed load gets close to the budget; stepping back up needs sustained
+// headroom (hysteresis) so the detector doesn't oscillate between tiers.
+class QualityController {
+public:
+    enum class Tier { full = 0, reducedRate, tinyModel, dspEstimator };
+    static constexpr int numTiers = 4;
+
+    QualityController();
+
+    // Tiers whose backing model isn't loaded are skipped when walking the ladder
+    void setTierAvailable(Tier tier, bool available);
+    bool isTierAvailable(Tier tier) const { return tierAvailable[static_cast<size_t>(tier)].load(); }
+
+    // Feed one inference measurement; returns true if the tier changed
+    bool reportInference(double inferenceSeconds, double budgetSeconds);
+
+    void reset();
+
+    Tier getCurrentTier() const { return currentTier.load(std::memory_order_relaxed); }
+    float getSmoothedLoad() const { return smoothedLoad.load(std::memory_order_relaxed); }
+
+    static const char* getTierName(Tier tier);
+
+private:
+    // Load is inference time / hop budget
+    static constexpr double downgradeLoad = 0.75;  // about to fall behind
+    static constexpr double upgradeLoad = 0.35;    // comfortable headroom
+    static constexpr double smoothing = 0.2;
+    static constexpr int framesToDowngrade = 3;
+    static constexpr int framesToUpgrade = 100;
+    static constexpr int maxFramesToUpgrade = 3200;
+
+    std::atomic<Tier> currentTier{ Tier::full };
+    std::atomic<float> smoothedLoad{ 0.0f };
+    std::array<std::atomic<bool>, numTiers> tierAvailable;  // a model hot swap can change these
+    double load = 0.0;
+    int overloadedFrames = 0;
+    int headroomFrames = 0;
+    int upgradeHoldFrames = framesToUpgrade;  // doubles every time an upgrade doesn't stick
+    int framesSinceUpgrade = -1;
+
+    bool stepDown();
+    bool stepUp();
+    void setTier(Tier tier);
+};
@@ -0,0 +1,264 @@
+#include "RealtimeGuard.h"
+
+#if COUNTERTUNE_REALTIME_GUARD
+
+#include <array>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <malloc.h>
+#else
+ #include <execinfo.h>
+#endif
+
+#ifndef COUNTERTUNE_REALTIME_GUARD_INTERPOSE_MALLOC
+ #define COUNTERTUNE_REALTIME_GUARD_INTERPOSE_MALLOC 0
+#endif
+
+namespace RealtimeGuard {
+
+    namespace {
+        constexpr int maxRecords = 32;
+        constexpr int maxFrames = 24;
+
+        struct Record {
+            std::atomic<bool> ready{ false };
+            Violation kind = Violation::allocation;
+            int numFrames = 0;
+            void* frames[maxFrames] = {};
+        };
+
+        std::array<std::atomic<juce::uint64>, static_cast<size_t>(Violation::numViolations)> counts{};
+        std::array<Record, maxRecords> records;
+        std::atomic<int> numRecords{ 0 };
+        std::atomic<bool> assertOnViolation{ false };
+
+        // plain ints so they're usable from operator new before anything else is constructed
+        thread_local int realtimeDepth = 0;
+        thread_local bool reporting = false;
+
+        int captureStack(void** frames, int capacity) {
+           #if JUCE_WINDOWS
+            return static_cast<int>(RtlCaptureStackBackTrace(2, static_cast<DWORD>(capacity), frames, nullptr));
+           #else
+            return backtrace(frames, capacity);
+           #endif
+        }
+
+        // glibc loads the unwinder, and allocates, on the first backtrace. Get that out of the way
+        // at load time instead of in the middle of the first report.
+        struct UnwinderPreload {
+            UnwinderPreload() { void* frames[2]; captureStack(frames, 2); }
+        } unwinderPreload;
+
+        const char* getViolationName(Violation kind) {
+            switch (kind) {
+                case Violation::allocation:   return "allocation";
+                case Violation::deallocation: return "deallocation";
+                case Violation::lock:         return "lock";
+                default:                      return "unknown";
+            }
+        }
+    }
+
+    void enterRealtimeSection() noexcept { ++realtimeDepth; }
+    void exitRealtimeSection() noexcept { --realtimeDepth; }
+    bool isInRealtimeSection() noexcept { return realtimeDepth > 0; }
+
+    void check(Violation kind) noexcept {
+        if (realtimeDepth <= 0 || reporting) return;
+
+        // anything the report itself does mustn't count again
+        reporting = true;
+
+        counts[static_cast<size_t>(kind)].fetch_add(1, std::memory_order_relaxed);
+
+        const int index = numRecords.fetch_add(1, std::memory_order_relaxed);
+        if (index < maxRecords) {
+            auto& record = records[static_cast<size_t>(index)];
+            record.kind = kind;
+            record.numFrames = captureStack(record.frames, maxFrames);
+            record.ready.store(true, std::memory_order_release);
+        }
+
+        if (assertOnViolation.load(std::memory_order_relaxed))
+            jassertfalse; // the realtime section this thread is in just did something it shouldn't
+
+        reporting = false;
+    }
+
+    juce::uint64 getViolationCount() noexcept {
+        juce::uint64 total = 0;
+        for (auto& count : counts)
+            total += count.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    juce::uint64 getViolationCount(Violation kind) noexcept {
+        return counts[static_cast<size_t>(kind)].load(std::memory_order_relaxed);
+    }
+
+    void resetViolations() noexcept {
+        for (auto& count : counts)
+            count.store(0, std::memory_order_relaxed);
+        for (auto& record : records)
+            record.ready.store(false, std::memory_order_relaxed);
+        numRecords.store(0, std::memory_order_relaxed);
+    }
+
+    void setAssertOnViolation(bool shouldAssert) noexcept {
+        assertOnViolation.store(shouldAssert, std::memory_order_relaxed);
+    }
+
+    juce::String describeViolations() {
+        juce::String description;
+
+        for (int kind = 0; kind < static_cast<int>(Violation::numViolations); ++kind)
+            description << getViolationName(static_cast<Violation>(kind)) << ": "
+                        << juce::String(getViolationCount(static_cast<Violation>(kind))) << "\n";
+
+        const int captured = juce::jmin(numRecords.load(), maxRecords);
+        for (int i = 0; i < captured; ++i) {
+            auto& record = records[static_cast<size_t>(i)];
+            if (!record.ready.load(std::memory_order_acquire)) continue;
+
+            description << "\n#" << juce::String(i) << " " << getViolationName(record.kind) << "\n";
+
+           #if JUCE_WINDOWS
+            for (int f = 0; f < record.numFrames; ++f)
+                description << "    " << juce::String::toHexString(reinterpret_cast<juce::pointer_sized_int>(record.frames[f])) << "\n";
+           #else
+            if (char** symbols = backtrace_symbols(record.frames, record.numFrames)) {
+                for (int f = 0; f < record.numFrames; ++f)
+                    description << "    " << symbols[f] << "\n";
+                std::free(symbols);
+            }
+           #endif
+        }
+
+        return description;
+    }
+}
+
+//==============================================================================
+#if ! COUNTERTUNE_REALTIME_GUARD_TRACK_HEAP
+
+// sections and locks only, the binary keeps its own allocator
+
+#elif COUNTERTUNE_REALTIME_GUARD_INTERPOSE_MALLOC && JUCE_LINUX
+
+// The whole process goes through these, operator new included since libstdc++ builds it on malloc
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void __libc_free(void*);
+
+    void* malloc(size_t size) {
+        RealtimeGuard::check(RealtimeGuard::Violation::allocation);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        RealtimeGuard::check(RealtimeGuard::Violation::allocation);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        RealtimeGuard::check(RealtimeGuard::Violation::allocation);
+        return __libc_realloc(ptr, size);
+    }
+
+    void free(void* ptr) {
+        if (ptr != nullptr)
+            RealtimeGuard::check(RealtimeGuard::Violation::deallocation);
+        __libc_free(ptr);
+    }
+}
+
+#else
+
+namespace {
+    void* checkedAllocate(size_t size) noexcept {
+        RealtimeGuard::check(RealtimeGuard::Violation::allocation);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void* checkedAllocateAligned(size_t size, std::align_val_t alignment) noexcept {
+        RealtimeGuard::check(RealtimeGuard::Violation::allocation);
+        const auto align = juce::jmax(static_cast<size_t>(alignment), sizeof(void*));
+       #if JUCE_WINDOWS
+        return _aligned_malloc(size == 0 ? 1 : size, align);
+       #else
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, align, size == 0 ? 1 : size) == 0 ? ptr : nullptr;
+       #endif
+    }
+
+    void checkedFree(void* ptr) noexcept {
+        if (ptr == nullptr) return;
+        RealtimeGuard::check(RealtimeGuard::Violation::deallocation);
+        std::free(ptr);
+    }
+
+    void checkedFreeAligned(void* ptr) noexcept {
+        if (ptr == nullptr) return;
+        RealtimeGuard::check(RealtimeGuard::Violation::deallocation);
+       #if JUCE_WINDOWS
+        _aligned_free(ptr);
+       #else
+        std::free(ptr);
+       #endif
+    }
+
+    template <typename Allocate>
+    void* allocateOrThrow(Allocate&& allocate) {
+        if (void* ptr = allocate())
+            return ptr;
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(size_t size) { return allocateOrThrow([=] { return checkedAllocate(size); }); }
+void* operator new[](size_t size) { return allocateOrThrow([=] { return checkedAllocate(size); }); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return checkedAllocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return checkedAllocate(size); }
+
+void* operator new(size_t size, std::align_val_t alignment) { return allocateOrThrow([=] { return checkedAllocateAligned(size, alignment); }); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateOrThrow([=] { return checkedAllocateAligned(size, alignment); }); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return checkedAllocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return checkedAllocateAligned(size, alignment); }
+
+void operator delete(void* ptr) noexcept { checkedFree(ptr); }
+void operator delete[](void* ptr) noexcept { checkedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { checkedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { checkedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { checkedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { checkedFree(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { checkedFreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { checkedFreeAligned(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { checkedFreeAligned(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { checkedFreeAligned(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { checkedFreeAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { checkedFreeAligned(ptr); }
+
+#endif
+
+#else
+
+namespace RealtimeGuard {
+    void enterRealtimeSection() noexcept {}
+    void exitRealtimeSection() noexcept {}
+    bool isInRealtimeSection() noexcept { return false; }
+    void check(Violation) noexcept {}
+    juce::uint64 getViolationCount() noexcept { return 0; }
+    juce::uint64 getViolationCount(Violation) noexcept { return 0; }
+    void resetViolations() noexcept {}
+    void setAssertOnViolation(bool) noexcept {}
+    juce::String describeViolations() { return "realtime guard not compiled in (COUNTERTUNE_REALTIME_GUARD=0)\n"; }
+}
+
+#endif
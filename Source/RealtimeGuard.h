@@ -0,0 +1,85 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Catches work that has no place on the audio thread. processBlock marks itself as a realtime
+// section, and while a thread is inside one every heap allocation or free and every
+// CheckedCriticalSection lock counts as a violation. The first few violations keep a stack
+// capture. getViolationCount() lets a headless harness that drives processBlock fail on a
+// regression, setAssertOnViolation() stops in the debugger at the offending call instead.
+//
+// Heap tracking replaces the global operator new/delete of the whole binary, so it's only compiled
+// in with COUNTERTUNE_REALTIME_GUARD_TRACK_HEAP=1. The console tools and tests always set it, the
+// plugin only with the COUNTERTUNE_REALTIME_GUARD CMake option. Executables that also want raw
+// malloc/free from C code caught on Linux can build with COUNTERTUNE_REALTIME_GUARD_INTERPOSE_MALLOC=1,
+// never the plugin itself since that would interpose the host's allocator.
+//
+// Sections and lock checks are on by default in debug builds, COUNTERTUNE_REALTIME_GUARD=1 turns
+// them on in release too.
+
+#ifndef COUNTERTUNE_REALTIME_GUARD
+ #define COUNTERTUNE_REALTIME_GUARD JUCE_DEBUG
+#endif
+
+#ifndef COUNTERTUNE_REALTIME_GUARD_TRACK_HEAP
+ #define COUNTERTUNE_REALTIME_GUARD_TRACK_HEAP 0
+#endif
+
+namespace RealtimeGuard {
+
+    enum class Violation { allocation = 0, deallocation, lock, numViolations };
+
+    constexpr bool isEnabled() { return COUNTERTUNE_REALTIME_GUARD != 0; }
+
+    // Realtime sections nest, the thread stays marked until the outermost one ends
+    void enterRealtimeSection() noexcept;
+    void exitRealtimeSection() noexcept;
+    bool isInRealtimeSection() noexcept;
+
+    // Counts the violation when the calling thread is in a realtime section
+    void check(Violation kind) noexcept;
+
+    juce::uint64 getViolationCount() noexcept;
+    juce::uint64 getViolationCount(Violation kind) noexcept;
+    void resetViolations() noexcept;
+    void setAssertOnViolation(bool shouldAssert) noexcept;
+
+    // Kind and symbolised stack of the captured violations, call from anywhere but the audio thread
+    juce::String describeViolations();
+
+    class ScopedRealtimeSection {
+    public:
+        explicit ScopedRealtimeSection(bool isRealtime = true) noexcept : active(isRealtime) { if (active) enterRealtimeSection(); }
+        ~ScopedRealtimeSection() noexcept { if (active) exitRealtimeSection(); }
+
+    private:
+        const bool active;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+    };
+
+    // Stands in for juce::CriticalSection and reports being locked from a realtime section. Wraps
+    // rather than derives, so a juce::ScopedLock can't take it past the check.
+    class CheckedCriticalSection {
+    public:
+        CheckedCriticalSection() = default;
+
+        void enter() const noexcept { check(Violation::lock); lock.enter(); }
+        bool tryEnter() const noexcept { check(Violation::lock); return lock.tryEnter(); }
+        void exit() const noexcept { lock.exit(); }
+
+        using ScopedLockType = juce::GenericScopedLock<CheckedCriticalSection>;
+
+    private:
+        juce::CriticalSection lock;
+
+        JUCE_DECLARE_NON_COPYABLE(CheckedCriticalSection)
+    };
+}
+
+#if COUNTERTUNE_REALTIME_GUARD
+ #define CT_REALTIME_SECTION() const RealtimeGuard::ScopedRealtimeSection JUCE_JOIN_MACRO(realtimeSection_, __LINE__)
+ #define CT_REALTIME_SECTION_IF(isRealtime) const RealtimeGuard::ScopedRealtimeSection JUCE_JOIN_MACRO(realtimeSection_, __LINE__)(isRealtime)
+#else
+ #define CT_REALTIME_SECTION()
+ #define CT_REALTIME_SECTION_IF(isRealtime)
+#endif
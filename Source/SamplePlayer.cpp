@@ -0,0 +1,274 @@
+#include "SamplePlayer.h"
+#include <cmath>
+
+namespace {
+    const char* const slotResourceNames[SamplePlayer::numSlots] = {
+        "sample_a_wav", "sample_b_wav", "sample_c_wav", "sample_d_wav", "sample_e_wav"
+    };
+}
+
+SamplePlayer::SamplePlayer() {
+    formatManager.registerBasicFormats();
+}
+
+void SamplePlayer::prepare(double sampleRate, int maxBlockSize) {
+    // in budget mode the sources are gone after resampling, only a new rate needs them again
+    if (!decoded && sampleRate != preparedRate) {
+        decoded = true;
+        decode("test_note_71_wav", testNote);
+        testNote.rootNote = 71;
+
+        for (int slot = 0; slot < numSlots; ++slot) {
+            auto& sample = samples[static_cast<size_t>(slot)];
+            if (!decode(slotResourceNames[slot], sample)) {
+                sample.source.makeCopyOf(testNote.source);
+                sample.sourceRate = testNote.sourceRate;
+                sample.rootNote = testNote.rootNote;
+            }
+        }
+    }
+
+    if (sampleRate != preparedRate) {
+        preparedRate = sampleRate;
+        resample(testNote, sampleRate);
+        for (auto& sample : samples)
+            resample(sample, sampleRate);
+
+        if (lowMemory) {
+            decoded = false;
+            testNote.source.setSize(0, 0);
+            for (auto& sample : samples)
+                sample.source.setSize(0, 0);
+        }
+    }
+
+    releaseSamples = juce::jmax(1, juce::roundToInt(releaseSeconds * sampleRate));
+    scratch.setSize(4, juce::jmax(1, maxBlockSize));
+
+    auto bufferBytes = [](const juce::AudioBuffer<float>& b) {
+        return static_cast<size_t>(b.getNumChannels()) * static_cast<size_t>(b.getNumSamples()) * sizeof(float);
+    };
+    size_t bytes = bufferBytes(testNote.source) + bufferBytes(testNote.data);
+    for (const auto& sample : samples)
+        bytes += bufferBytes(sample.source) + bufferBytes(sample.data);
+    sampleBytes.store(bytes);
+    scratchBytes.store(bufferBytes(scratch));
+
+    // nothing survives a re-prepare, the buffers the voices pointed into may be new
+    voices.fill(Voice());
+    stolenTails.fill(Voice());
+    testVoice = Voice();
+    playingSlot = noSlot;
+}
+
+bool SamplePlayer::decode(const char* resourceName, Sample& sample) {
+    int size = 0;
+    const char* data = BinaryData::getNamedResource(resourceName, size);
+    if (data == nullptr || size <= 0) return false;
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(
+        std::make_unique<juce::MemoryInputStream>(data, static_cast<size_t>(size), false)));
+    if (reader == nullptr || reader->lengthInSamples <= 0) return false;
+
+    const int numChannels = juce::jlimit(1, 2, static_cast<int>(reader->numChannels));
+    const int length = static_cast<int>(reader->lengthInSamples);
+    sample.source.setSize(numChannels, length);
+    reader->read(&sample.source, 0, length, 0, true, numChannels > 1);
+    sample.sourceRate = reader->sampleRate;
+    return true;
+}
+
+void SamplePlayer::resample(Sample& sample, double sampleRate) {
+    if (sample.source.getNumSamples() < 2 || sample.sourceRate <= 0.0) {
+        sample.data.setSize(1, 0);
+        return;
+    }
+
+    // the interpolator never has to read past the last decoded sample
+    const double ratio = sample.sourceRate / sampleRate;
+    const int length = juce::jmax(1, static_cast<int>((sample.source.getNumSamples() - 1) / ratio));
+
+    // one silent guard sample on the end, so the voices can always read the right neighbour
+    sample.data.setSize(sample.source.getNumChannels(), length + 1);
+    sample.data.clear();
+    for (int channel = 0; channel < sample.source.getNumChannels(); ++channel) {
+        juce::LagrangeInterpolator interpolator;
+        interpolator.process(ratio, sample.source.getReadPointer(channel), sample.data.getWritePointer(channel), length);
+    }
+}
+
+void SamplePlayer::startVoice(const Sample& sample, int note, float velocity) {
+    if (sample.data.getNumSamples() < 2) return;
+
+    // a free voice, otherwise the one that's been going longest
+    Voice* voice = &voices[0];
+    for (auto& candidate : voices) {
+        if (candidate.sample == nullptr) {
+            voice = &candidate;
+            break;
+        }
+        if (candidate.startOrder < voice->startOrder)
+            voice = &candidate;
+    }
+
+    // a stolen voice would stop dead mid-sample, it fades out in a tail slot instead. a tail
+    // that's still going when all of them are taken is the one closest to silence anyway
+    if (voice->sample != nullptr) {
+        Voice* tail = &stolenTails[0];
+        for (auto& candidate : stolenTails) {
+            if (candidate.sample == nullptr) {
+                tail = &candidate;
+                break;
+            }
+            if (candidate.releaseRemaining < tail->releaseRemaining)
+                tail = &candidate;
+        }
+
+        *tail = *voice;
+        if (tail->releaseRemaining < 0 || tail->releaseRemaining > releaseSamples)
+            tail->releaseRemaining = releaseSamples;
+    }
+
+    voice->sample = &sample;
+    voice->note = note;
+    voice->position = 0.0;
+    voice->increment = std::pow(2.0, (note - sample.rootNote) / 12.0);
+    voice->gain = velocity;
+    voice->releaseRemaining = -1;
+    voice->startOrder = nextStartOrder++;
+}
+
+void SamplePlayer::releaseVoice(int note) noexcept {
+    for (auto& voice : voices)
+        if (voice.sample != nullptr && voice.note == note && voice.releaseRemaining < 0)
+            voice.releaseRemaining = releaseSamples;
+}
+
+void SamplePlayer::addMemoryUsage(MemoryAccounting::Report& report) const {
+    report.add("samples", sampleBytes.load());
+    report.add("sample scratch", scratchBytes.load());
+}
+
+void SamplePlayer::allNotesOff() noexcept {
+    for (auto& voice : voices)
+        if (voice.sample != nullptr && voice.releaseRemaining < 0)
+            voice.releaseRemaining = releaseSamples;
+}
+
+void SamplePlayer::renderVoice(Voice& voice, juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept {
+    const auto& data = voice.sample->data;
+    const int length = data.getNumSamples() - 1;  // without the guard
+    const int numOutputs = juce::jmin(2, buffer.getNumChannels());
+    const int numSampleChannels = juce::jmin(data.getNumChannels(), numOutputs);
+
+    float* left = scratch.getWritePointer(0);
+    float* right = scratch.getWritePointer(1);
+    float* fraction = scratch.getWritePointer(2);
+    float* out = scratch.getWritePointer(3);
+
+    int done = 0;
+    while (done < numSamples) {
+        // as much as fits the scratch, stops where the sample or the release runs out
+        int n = juce::jmin(numSamples - done, scratch.getNumSamples());
+        const double remaining = (length - 1 - voice.position) / voice.increment;
+        n = remaining < 0.0 ? 0 : juce::jmin(n, static_cast<int>(remaining) + 1);
+        if (voice.releaseRemaining >= 0)
+            n = juce::jmin(n, voice.releaseRemaining);
+
+        if (n <= 0) {
+            voice.sample = nullptr;
+            return;
+        }
+
+        const float startGain = voice.releaseRemaining < 0 ? voice.gain
+            : voice.gain * static_cast<float>(voice.releaseRemaining) / static_cast<float>(releaseSamples);
+        const float endGain = voice.releaseRemaining < 0 ? voice.gain
+            : voice.gain * static_cast<float>(voice.releaseRemaining - n) / static_cast<float>(releaseSamples);
+
+        for (int channel = 0; channel < numSampleChannels; ++channel) {
+            // gather the neighbours, the interpolation itself is vectorised
+            const float* src = data.getReadPointer(channel);
+            for (int i = 0; i < n; ++i) {
+                const double position = voice.position + i * voice.increment;
+                const int index = static_cast<int>(position);
+                left[i] = src[index];
+                right[i] = src[index + 1];
+                if (channel == 0)
+                    fraction[i] = static_cast<float>(position - index);
+            }
+
+            juce::FloatVectorOperations::subtract(out, right, left, n);
+            juce::FloatVectorOperations::multiply(out, fraction, n);
+            juce::FloatVectorOperations::add(out, left, n);
+
+            // a mono sample goes to both sides
+            if (data.getNumChannels() == 1) {
+                for (int output = 0; output < numOutputs; ++output)
+                    buffer.addFromWithRamp(output, startSample + done, out, n, startGain, endGain);
+            }
+            else {
+                buffer.addFromWithRamp(channel, startSample + done, out, n, startGain, endGain);
+            }
+        }
+
+        voice.position += n * voice.increment;
+        done += n;
+
+        if (voice.releaseRemaining >= 0) {
+            voice.releaseRemaining -= n;
+            if (voice.releaseRemaining == 0) {
+                voice.sample = nullptr;
+                return;
+            }
+        }
+    }
+}
+
+void SamplePlayer::renderVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept {
+    if (numSamples <= 0) return;
+    for (auto* pool : { &voices, &stolenTails })
+        for (auto& voice : *pool)
+            if (voice.sample != nullptr)
+                renderVoice(voice, buffer, startSample, numSamples);
+}
+
+void SamplePlayer::renderTestNote(juce::AudioBuffer<float>& buffer) {
+    if (testNoteRequested.exchange(false) && testNote.data.getNumSamples() > 1) {
+        testVoice = Voice();
+        testVoice.sample = &testNote;
+        testVoice.note = testNote.rootNote;
+        testVoice.gain = 1.0f;
+    }
+
+    if (testVoice.sample != nullptr)
+        renderVoice(testVoice, buffer, 0, buffer.getNumSamples());
+}
+
+void SamplePlayer::render(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midi) {
+    const int slot = selectedSlot.load();
+    if (slot != playingSlot) {
+        allNotesOff();
+        playingSlot = slot;
+    }
+
+    const int numSamples = buffer.getNumSamples();
+    int position = 0;
+    for (const auto metadata : midi) {
+        const int eventPosition = juce::jlimit(position, numSamples, metadata.samplePosition);
+        renderVoices(buffer, position, eventPosition - position);
+        position = eventPosition;
+
+        const auto message = metadata.getMessage();
+        if (message.isNoteOn()) {
+            if (playingSlot != noSlot)
+                startVoice(samples[static_cast<size_t>(playingSlot)], message.getNoteNumber(), message.getFloatVelocity());
+        }
+        else if (message.isNoteOff()) {
+            releaseVoice(message.getNoteNumber());
+        }
+        else if (message.isAllNotesOff() || message.isAllSoundOff()) {
+            allNotesOff();
+        }
+    }
+    renderVoices(buffer, position, numSamples - position);
+}
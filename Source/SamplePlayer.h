@@ -0,0 +1,93 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include "MemoryAccounting.h"
+
+// Plays the counter-melody through one of the sample slots A-E, plus the test note the pitch
+// path can be fed with. Every sample is decoded and resampled to the session rate in prepare,
+// the audio thread only reads those buffers: a fixed pool of voices, linear interpolation for
+// the pitch shift, no allocation and no file access.
+//
+// Slot n is the binary resource sample_<a-e>_wav, rooted at middle C. A slot without its
+// resource falls back to test_note_71_wav at its own root.
+class SamplePlayer {
+public:
+    static constexpr int numSlots = 5;
+    static constexpr int noSlot = -1;
+    static constexpr int maxVoices = 8;
+
+    SamplePlayer();
+
+    // message thread, not while rendering. allocates, decodes the resources on the first call
+    void prepare(double sampleRate, int maxBlockSize);
+
+    // slot the counter-melody plays through, noSlot = silent. any thread
+    void setSlot(int slot) noexcept { selectedSlot.store(juce::jlimit(noSlot, numSlots - 1, slot)); }
+    int getSlot() const noexcept { return selectedSlot.load(); }
+
+    // one-shot of the test note at its own pitch, rendered by renderTestNote. any thread
+    void playTestNote() noexcept { testNoteRequested.store(true); }
+
+    // Audio thread. renderTestNote mixes the test note into the first two channels, render plays
+    // the note ons and offs in midi through the selected slot, sample accurate.
+    void renderTestNote(juce::AudioBuffer<float>& buffer);
+    void render(juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midi);
+    void allNotesOff() noexcept;
+
+    // Budget mode: the decoded sources are dropped once resampled and decoded again when the rate
+    // changes, so only the session rate copies stay resident. Set before prepare.
+    void setLowMemory(bool enabled) noexcept { lowMemory = enabled; }
+
+    // decoded and resampled samples plus scratch, as of the last prepare. any thread
+    void addMemoryUsage(MemoryAccounting::Report& report) const;
+
+private:
+    struct Sample {
+        juce::AudioBuffer<float> source;  // as decoded
+        double sourceRate = 0.0;
+        juce::AudioBuffer<float> data;    // at the session rate
+        int rootNote = 60;
+    };
+
+    struct Voice {
+        const Sample* sample = nullptr;  // nullptr = free
+        int note = -1;
+        double position = 0.0;
+        double increment = 1.0;
+        float gain = 0.0f;
+        int releaseRemaining = -1;       // counts down to silence once released, -1 = held
+        juce::uint32 startOrder = 0;
+    };
+
+    static constexpr double releaseSeconds = 0.01;
+
+    juce::AudioFormatManager formatManager;
+    std::array<Sample, numSlots> samples;
+    Sample testNote;
+    bool decoded = false;
+    bool lowMemory = false;
+    double preparedRate = 0.0;
+    int releaseSamples = 1;
+
+    std::array<Voice, maxVoices> voices;
+    std::array<Voice, maxVoices> stolenTails;  // stolen voices finishing their release ramp
+    Voice testVoice;
+    juce::uint32 nextStartOrder = 0;
+    int playingSlot = noSlot;  // audio thread copy, a slot change releases whatever is sounding
+
+    // interpolation scratch: left and right neighbour, fraction, result
+    juce::AudioBuffer<float> scratch;
+
+    std::atomic<int> selectedSlot{ noSlot };
+    std::atomic<bool> testNoteRequested{ false };
+    std::atomic<size_t> sampleBytes{ 0 };
+    std::atomic<size_t> scratchBytes{ 0 };
+
+    bool decode(const char* resourceName, Sample& sample);
+    void resample(Sample& sample, double sampleRate);
+    void startVoice(const Sample& sample, int note, float velocity);
+    void releaseVoice(int note) noexcept;
+    void renderVoice(Voice& voice, juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept;
+    void renderVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept;
+};
@@ -0,0 +1,277 @@
+#include "SessionCapture.h"
+
+namespace SessionCapture {
+
+    namespace {
+        const char magic[4] = { 'C', 'T', 'S', 'C' };
+        constexpr int maxBlockSamples = 1 << 20;
+
+        void writeBlockInfo(juce::OutputStream& out, const BlockInfo& info) {
+            out.writeInt(info.numSamples);
+            out.writeInt(static_cast<int>(info.flags));
+            out.writeDouble(info.bpm);
+            out.writeDouble(info.ppqPosition);
+            out.writeInt64(info.timeInSamples);
+            out.writeDouble(info.loopStartPpq);
+            out.writeDouble(info.loopEndPpq);
+        }
+
+        void readBlockInfo(juce::InputStream& in, BlockInfo& info) {
+            info.numSamples = in.readInt();
+            info.flags = static_cast<juce::uint32>(in.readInt());
+            info.bpm = in.readDouble();
+            info.ppqPosition = in.readDouble();
+            info.timeInSamples = in.readInt64();
+            info.loopStartPpq = in.readDouble();
+            info.loopEndPpq = in.readDouble();
+        }
+    }
+
+    BlockInfo BlockInfo::fromPlayHead(juce::AudioPlayHead* playHead, int numSamples) noexcept {
+        BlockInfo info;
+        info.numSamples = numSamples;
+
+        const auto position = playHead != nullptr ? playHead->getPosition() : juce::Optional<juce::AudioPlayHead::PositionInfo>();
+        if (!position.hasValue()) return info;
+
+        info.flags |= hasPosition;
+        if (position->getIsPlaying()) info.flags |= isPlaying;
+        if (position->getIsLooping()) info.flags |= isLooping;
+
+        if (const auto bpm = position->getBpm()) {
+            info.flags |= hasBpm;
+            info.bpm = *bpm;
+        }
+        if (const auto ppq = position->getPpqPosition()) {
+            info.flags |= hasPpqPosition;
+            info.ppqPosition = *ppq;
+        }
+        if (const auto time = position->getTimeInSamples()) {
+            info.flags |= hasTimeInSamples;
+            info.timeInSamples = *time;
+        }
+        if (const auto loop = position->getLoopPoints()) {
+            info.flags |= hasLoopPoints;
+            info.loopStartPpq = loop->ppqStart;
+            info.loopEndPpq = loop->ppqEnd;
+        }
+        return info;
+    }
+
+    juce::Optional<juce::AudioPlayHead::PositionInfo> BlockInfo::toPosition() const {
+        if ((flags & hasPosition) == 0) return {};
+
+        juce::AudioPlayHead::PositionInfo position;
+        position.setIsPlaying((flags & isPlaying) != 0);
+        position.setIsLooping((flags & isLooping) != 0);
+        if (flags & hasBpm) position.setBpm(bpm);
+        if (flags & hasPpqPosition) position.setPpqPosition(ppqPosition);
+        if (flags & hasTimeInSamples) position.setTimeInSamples(timeInSamples);
+        if (flags & hasLoopPoints) position.setLoopPoints(juce::AudioPlayHead::LoopPoints{ loopStartPpq, loopEndPpq });
+        return position;
+    }
+
+    //==============================================================================
+    Recorder::Recorder() : juce::Thread("Session Capture Writer") {}
+
+    Recorder::~Recorder() {
+        stop();
+    }
+
+    bool Recorder::start(const juce::File& file, const Header& header) {
+        stop();
+
+        if (header.numChannels < 1 || header.maxBlockSize < 1) return false;
+
+        file.deleteFile();
+        auto fileStream = std::make_unique<juce::FileOutputStream>(file);
+        if (fileStream->failedToOpen()) return false;
+
+        stream = std::make_unique<juce::GZIPCompressorOutputStream>(fileStream.release(), 6, true);
+        stream->write(magic, sizeof(magic));
+        stream->writeInt(currentVersion);
+        stream->writeDouble(header.sampleRate);
+        stream->writeInt(header.numChannels);
+        stream->writeInt(header.maxBlockSize);
+        stream->writeInt(static_cast<int>(header.seed));
+        stream->writeInt(static_cast<int>(header.downmixMode));
+        stream->writeInt(header.downmixChannel);
+        stream->writeInt(header.keyConstraint ? 1 : 0);
+        stream->writeInt(header.sampleSlot);
+        stream->writeDouble(header.fallbackBpm);
+
+        // allocated once, the audio thread can't be in the ring while we're not recording
+        if (ring == nullptr) {
+            ring.allocate(static_cast<size_t>(ringBytes), false);
+            allocatedBytes.store(static_cast<size_t>(ringBytes), std::memory_order_relaxed);
+        }
+        fifo.reset();
+        numChannels = header.numChannels;
+        droppedBlocks.store(0);
+
+        recording.store(true, std::memory_order_release);
+        startThread();
+        return true;
+    }
+
+    void Recorder::stop() {
+        if (!recording.exchange(false)) return;
+
+        // a block that saw recording still on finishes its write first, the drain below has to
+        // see it and the next start mustn't reset the fifo under it. one block's copy at most
+        while (blocksInFlight.load() > 0)
+            juce::Thread::yield();
+
+        stopThread(2000);
+        drain();
+        stream->flush();
+        stream.reset();
+    }
+
+    void Recorder::recordBlock(const juce::AudioBuffer<float>& buffer, juce::AudioPlayHead* playHead) noexcept {
+        // counted in before looking at the flag, so stop either sees this block or the block sees stop
+        struct InFlight {
+            std::atomic<int>& count;
+            explicit InFlight(std::atomic<int>& c) noexcept : count(c) { count.fetch_add(1); }
+            ~InFlight() { count.fetch_sub(1); }
+        } inFlight(blocksInFlight);
+
+        if (!recording.load() || buffer.getNumChannels() < 1) return;
+
+        const int numSamples = buffer.getNumSamples();
+        const auto info = BlockInfo::fromPlayHead(playHead, numSamples);
+        const int channelBytes = numSamples * static_cast<int>(sizeof(float));
+        const int recordBytes = static_cast<int>(sizeof(BlockInfo)) + numChannels * channelBytes;
+
+        if (fifo.getFreeSpace() < recordBytes) {
+            droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(recordBytes, start1, size1, start2, size2);
+
+        int position = start1;
+        writeToRing(&info, static_cast<int>(sizeof(BlockInfo)), position);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            // a mono bus fills every recorded channel
+            const int sourceChannel = juce::jmin(ch, buffer.getNumChannels() - 1);
+            writeToRing(buffer.getReadPointer(sourceChannel), channelBytes, position);
+        }
+
+        // the record only becomes visible to the writer once it's complete
+        fifo.finishedWrite(recordBytes);
+    }
+
+    void Recorder::run() {
+        while (!threadShouldExit()) {
+            drain();
+            wait(20);
+        }
+    }
+
+    void Recorder::drain() {
+        while (fifo.getNumReady() >= static_cast<int>(sizeof(BlockInfo))) {
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(static_cast<int>(sizeof(BlockInfo)), start1, size1, start2, size2);
+
+            int position = start1;
+            BlockInfo info;
+            readFromRing(&info, static_cast<int>(sizeof(BlockInfo)), position);
+
+            const auto numSamples = static_cast<size_t>(numChannels) * static_cast<size_t>(info.numSamples);
+            drainBuffer.resize(numSamples);
+            readFromRing(drainBuffer.data(), static_cast<int>(numSamples * sizeof(float)), position);
+
+            writeBlockInfo(*stream, info);
+            stream->write(drainBuffer.data(), numSamples * sizeof(float));
+
+            fifo.finishedRead(static_cast<int>(sizeof(BlockInfo) + numSamples * sizeof(float)));
+        }
+    }
+
+    void Recorder::writeToRing(const void* data, int numBytes, int& position) noexcept {
+        const int firstPart = juce::jmin(numBytes, ringBytes - position);
+        std::memcpy(ring + position, data, static_cast<size_t>(firstPart));
+        std::memcpy(ring.get(), static_cast<const char*>(data) + firstPart, static_cast<size_t>(numBytes - firstPart));
+        position = (position + numBytes) % ringBytes;
+    }
+
+    void Recorder::readFromRing(void* data, int numBytes, int& position) const noexcept {
+        const int firstPart = juce::jmin(numBytes, ringBytes - position);
+        std::memcpy(data, ring + position, static_cast<size_t>(firstPart));
+        std::memcpy(static_cast<char*>(data) + firstPart, ring.get(), static_cast<size_t>(numBytes - firstPart));
+        position = (position + numBytes) % ringBytes;
+    }
+
+    //==============================================================================
+    bool Capture::load(const juce::File& file, juce::String& error) {
+        header = {};
+        blocks.clear();
+        audio.clear();
+
+        juce::GZIPDecompressorInputStream in(new juce::FileInputStream(file), true);
+
+        char fileMagic[4] = {};
+        if (in.read(fileMagic, sizeof(fileMagic)) != sizeof(fileMagic) || std::memcmp(fileMagic, magic, sizeof(magic)) != 0) {
+            error = "not a session capture";
+            return false;
+        }
+
+        const int version = in.readInt();
+        if (version < 1 || version > currentVersion) {
+            error = "unsupported capture version " + juce::String(version);
+            return false;
+        }
+
+        header.sampleRate = in.readDouble();
+        header.numChannels = in.readInt();
+        header.maxBlockSize = in.readInt();
+        header.seed = static_cast<juce::uint32>(in.readInt());
+
+        if (version >= 2) {
+            const int mode = in.readInt();
+            header.downmixMode = static_cast<InputDownmix::Mode>(juce::jlimit(0, static_cast<int>(InputDownmix::Mode::channel), mode));
+            header.downmixChannel = in.readInt();
+            header.keyConstraint = in.readInt() != 0;
+            header.sampleSlot = in.readInt();
+            header.fallbackBpm = in.readDouble();
+        }
+
+        if (header.sampleRate <= 0.0 || header.numChannels < 1 || header.numChannels > 64 || !std::isfinite(header.fallbackBpm)) {
+            error = "corrupt header";
+            return false;
+        }
+
+        while (!in.isExhausted()) {
+            Block block;
+            readBlockInfo(in, block.info);
+
+            if (block.info.numSamples < 0 || block.info.numSamples > maxBlockSamples) {
+                error = "corrupt block " + juce::String(static_cast<int>(blocks.size()));
+                return false;
+            }
+
+            const auto numSamples = static_cast<size_t>(header.numChannels) * static_cast<size_t>(block.info.numSamples);
+            block.audioOffset = audio.size();
+            audio.resize(audio.size() + numSamples);
+
+            const auto numBytes = static_cast<int>(numSamples * sizeof(float));
+            if (in.read(audio.data() + block.audioOffset, numBytes) != numBytes) {
+                // the writer got cut off mid-block, keep everything before it
+                audio.resize(block.audioOffset);
+                break;
+            }
+            blocks.push_back(block);
+        }
+
+        return true;
+    }
+
+    double Capture::getLengthSeconds() const {
+        juce::int64 numSamples = 0;
+        for (const auto& block : blocks)
+            numSamples += block.info.numSamples;
+        return static_cast<double>(numSamples) / header.sampleRate;
+    }
+}
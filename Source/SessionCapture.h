@@ -0,0 +1,116 @@
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+#include "InputDownmix.h"
+
+// A recorded session: the audio the pitch path saw, the host transport of every block and the
+// melody RNG seed plus the settings that change the output, enough for the replay tool to push the
+// same blocks through processBlock again. Only the main input bus is recorded.
+//
+// File layout, gzipped, integers and doubles little-endian, samples raw float32:
+//   "CTSC" magic, int32 version, double sampleRate, int32 numChannels, int32 maxBlockSize, uint32 seed
+//   version 2 on: int32 downmixMode, int32 downmixChannel, int32 keyConstraint, int32 sampleSlot, double fallbackBpm
+//   then per block: BlockInfo fields in declaration order, numChannels * numSamples samples channel by channel
+namespace SessionCapture {
+
+    constexpr int currentVersion = 2;
+
+    // the defaults are the plugin's, a version 1 capture replays with them
+    struct Header {
+        double sampleRate = 44100.0;
+        int numChannels = 2;
+        int maxBlockSize = 512;
+        juce::uint32 seed = 0;
+        InputDownmix::Mode downmixMode = InputDownmix::Mode::mid;
+        int downmixChannel = 0;
+        bool keyConstraint = true;
+        int sampleSlot = -1;
+        double fallbackBpm = 140.0;
+    };
+
+    // Plain copy of what the play head reported for one block
+    struct BlockInfo {
+        enum Flags : juce::uint32 {
+            hasPosition = 1 << 0,
+            isPlaying = 1 << 1,
+            hasBpm = 1 << 2,
+            hasPpqPosition = 1 << 3,
+            hasTimeInSamples = 1 << 4,
+            isLooping = 1 << 5,
+            hasLoopPoints = 1 << 6
+        };
+
+        juce::int32 numSamples = 0;
+        juce::uint32 flags = 0;
+        double bpm = 0.0;
+        double ppqPosition = 0.0;
+        juce::int64 timeInSamples = 0;
+        double loopStartPpq = 0.0;
+        double loopEndPpq = 0.0;
+
+        static BlockInfo fromPlayHead(juce::AudioPlayHead* playHead, int numSamples) noexcept;
+        juce::Optional<juce::AudioPlayHead::PositionInfo> toPosition() const;
+    };
+
+    // Records from processBlock. The audio thread only copies into a preallocated ring, a
+    // background thread compresses and writes. Blocks that don't fit in the ring are dropped and
+    // counted, a capture with drops won't replay like the session did.
+    class Recorder : private juce::Thread {
+    public:
+        Recorder();
+        ~Recorder() override;
+
+        // Message thread
+        bool start(const juce::File& file, const Header& header);
+        void stop();
+        bool isRecording() const noexcept { return recording.load(std::memory_order_acquire); }
+        juce::uint64 getDroppedBlocks() const noexcept { return droppedBlocks.load(std::memory_order_relaxed); }
+
+        // the ring, allocated by the first start and kept from then on
+        static constexpr size_t getRingBytes() noexcept { return static_cast<size_t>(ringBytes); }
+        size_t getAllocatedBytes() const noexcept { return allocatedBytes.load(std::memory_order_relaxed); }
+
+        // Audio thread, lock- and allocation-free
+        void recordBlock(const juce::AudioBuffer<float>& buffer, juce::AudioPlayHead* playHead) noexcept;
+
+    private:
+        static constexpr int ringBytes = 1 << 23;  // ~10 s of stereo float at 96 kHz
+
+        void run() override;
+        void drain();
+        void writeToRing(const void* data, int numBytes, int& position) noexcept;
+        void readFromRing(void* data, int numBytes, int& position) const noexcept;
+
+        juce::HeapBlock<char> ring;
+        juce::AbstractFifo fifo{ ringBytes };
+        std::unique_ptr<juce::OutputStream> stream;
+        std::vector<float> drainBuffer;
+        int numChannels = 0;
+        std::atomic<bool> recording{ false };
+        std::atomic<int> blocksInFlight{ 0 };  // recordBlock calls between their flag check and their write
+        std::atomic<juce::uint64> droppedBlocks{ 0 };
+        std::atomic<size_t> allocatedBytes{ 0 };
+
+        JUCE_DECLARE_NON_COPYABLE(Recorder)
+    };
+
+    // A whole capture loaded into memory for replay
+    struct Capture {
+        struct Block {
+            BlockInfo info;
+            size_t audioOffset = 0;  // into audio, numChannels runs of info.numSamples
+        };
+
+        Header header;
+        std::vector<Block> blocks;
+        std::vector<float> audio;
+
+        bool load(const juce::File& file, juce::String& error);
+
+        const float* getChannel(const Block& block, int channel) const {
+            return audio.data() + block.audioOffset + static_cast<size_t>(channel) * static_cast<size_t>(block.info.numSamples);
+        }
+
+        double getLengthSeconds() const;
+    };
+}
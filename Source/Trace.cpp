@@ -0,0 +1,112 @@
+#include "Trace.h"
+#include <array>
+
+#if COUNTERTUNE_ENABLE_TRACING
+
+namespace Trace {
+
+    namespace {
+        constexpr int maxThreads = 16;
+        constexpr juce::uint64 eventsPerThread = 8192;
+
+        struct Event {
+            const char* name;
+            juce::int64 startTicks;
+            juce::int64 endTicks;
+        };
+
+        // One writer per ring, the oldest events get overwritten once it wraps
+        struct ThreadRing {
+            std::atomic<const char*> threadName{ nullptr };
+            std::atomic<juce::uint64> writeIndex{ 0 };
+            std::array<Event, eventsPerThread> events;
+        };
+
+        ThreadRing rings[maxThreads];
+        std::atomic<int> numRings{ 0 };
+
+        thread_local ThreadRing* currentRing = nullptr;
+        thread_local bool noRingLeft = false;
+
+        ThreadRing* getRing() {
+            if (currentRing == nullptr && !noRingLeft) {
+                const int index = numRings.fetch_add(1);
+                if (index < maxThreads)
+                    currentRing = &rings[index];
+                else
+                    noRingLeft = true;
+            }
+            return currentRing;
+        }
+    }
+
+    void nameCurrentThread(const char* name) {
+        if (auto* ring = getRing())
+            ring->threadName.store(name, std::memory_order_relaxed);
+    }
+
+    void record(const char* name, juce::int64 startTicks, juce::int64 endTicks) {
+        auto* ring = getRing();
+        if (ring == nullptr) return;
+
+        const auto index = ring->writeIndex.load(std::memory_order_relaxed);
+        ring->events[index % eventsPerThread] = { name, startTicks, endTicks };
+        ring->writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    bool writeChromeJson(juce::OutputStream& out) {
+        const double microsecondsPerTick = 1.0e6 / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+        const int threads = juce::jmin(numRings.load(), maxThreads);
+
+        out << "{\"traceEvents\":[";
+        bool first = true;
+
+        for (int t = 0; t < threads; ++t) {
+            auto& ring = rings[t];
+            const int tid = t + 1;
+
+            if (const char* threadName = ring.threadName.load(std::memory_order_relaxed)) {
+                out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                    << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+                first = false;
+            }
+
+            const auto end = ring.writeIndex.load(std::memory_order_acquire);
+            const auto begin = end > eventsPerThread ? end - eventsPerThread : 0;
+
+            for (auto i = begin; i < end; ++i) {
+                const Event event = ring.events[i % eventsPerThread];
+
+                // the writer may have lapped us while we were formatting, skip what it overwrote
+                if (ring.writeIndex.load(std::memory_order_acquire) - i > eventsPerThread)
+                    continue;
+
+                out << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                    << ",\"ts\":" << static_cast<double>(event.startTicks) * microsecondsPerTick
+                    << ",\"dur\":" << static_cast<double>(event.endTicks - event.startTicks) * microsecondsPerTick << "}";
+                first = false;
+            }
+        }
+
+        out << "\n]}\n";
+        return true;
+    }
+
+    bool dumpChromeJson(const juce::File& file) {
+        file.deleteFile();
+        juce::FileOutputStream out(file);
+        if (!out.openedOk()) return false;
+        return writeChromeJson(out);
+    }
+}
+
+#else
+
+namespace Trace {
+    void nameCurrentThread(const char*) {}
+    void record(const char*, juce::int64, juce::int64) {}
+    bool writeChromeJson(juce::OutputStream&) { return false; }
+    bool dumpChromeJson(const juce::File&) { return false; }
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Trace scopes for finding out where time goes across the audio, pitch and generation threads.
+// Every thread writes into its own preallocated lock-free ring, nothing is formatted or allocated
+// while recording. dumpChromeJson() writes everything recorded so far as Chrome trace JSON, which
+// loads in chrome://tracing and ui.perfetto.dev.
+//
+// Compiled in with COUNTERTUNE_ENABLE_TRACING=1, otherwise the macros expand to nothing.
+
+#ifndef COUNTERTUNE_ENABLE_TRACING
+ #define COUNTERTUNE_ENABLE_TRACING 0
+#endif
+
+namespace Trace {
+
+    constexpr bool isEnabled() { return COUNTERTUNE_ENABLE_TRACING != 0; }
+
+    // Names must be string literals, only the pointer is stored
+    void nameCurrentThread(const char* name);
+    void record(const char* name, juce::int64 startTicks, juce::int64 endTicks);
+
+    bool writeChromeJson(juce::OutputStream& out);
+    bool dumpChromeJson(const juce::File& file);
+
+    class Scope {
+    public:
+        explicit Scope(const char* scopeName)
+            : name(scopeName), startTicks(juce::Time::getHighResolutionTicks()) {}
+        ~Scope() { record(name, startTicks, juce::Time::getHighResolutionTicks()); }
+
+    private:
+        const char* name;
+        juce::int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+}
+
+#if COUNTERTUNE_ENABLE_TRACING
+ #define CT_TRACE_SCOPE(name) const Trace::Scope JUCE_JOIN_MACRO(traceScope_, __LINE__)(name)
+ #define CT_TRACE_THREAD(name) Trace::nameCurrentThread(name)
+#else
+ #define CT_TRACE_SCOPE(name)
+ #define CT_TRACE_THREAD(name)
+#endif
@@ -0,0 +1,82 @@
+// Checks that the realtime guard sees what it's there to see. Built with -DCOUNTERTUNE_BUILD_TESTS=ON
+// and run by ctest, exits non-zero on the first expectation that fails.
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "RealtimeGuard.h"
+
+namespace {
+
+    int failures = 0;
+
+    void expect(bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    using RealtimeGuard::Violation;
+
+    void allocationInsideSectionIsRecorded() {
+        RealtimeGuard::resetViolations();
+        {
+            CT_REALTIME_SECTION();
+            // called directly rather than through a new-expression, which the compiler may elide
+            void* block = ::operator new(64);
+            ::operator delete(block);
+        }
+        expect(RealtimeGuard::getViolationCount(Violation::allocation) == 1, "allocation in a realtime section is counted");
+        expect(RealtimeGuard::getViolationCount(Violation::deallocation) == 1, "free in a realtime section is counted");
+    }
+
+    void allocationOutsideSectionIsIgnored() {
+        RealtimeGuard::resetViolations();
+        void* block = ::operator new(64);
+        ::operator delete(block);
+        expect(RealtimeGuard::getViolationCount() == 0, "allocation outside a realtime section is not counted");
+    }
+
+    void lockInsideSectionIsRecorded() {
+        RealtimeGuard::CheckedCriticalSection lock;
+        RealtimeGuard::resetViolations();
+        {
+            CT_REALTIME_SECTION();
+            const RealtimeGuard::CheckedCriticalSection::ScopedLockType scopedLock(lock);
+        }
+        expect(RealtimeGuard::getViolationCount(Violation::lock) == 1, "lock in a realtime section is counted");
+
+        RealtimeGuard::resetViolations();
+        {
+            const RealtimeGuard::CheckedCriticalSection::ScopedLockType scopedLock(lock);
+        }
+        expect(RealtimeGuard::getViolationCount() == 0, "lock outside a realtime section is not counted");
+    }
+
+    void sectionsNest() {
+        RealtimeGuard::resetViolations();
+        {
+            CT_REALTIME_SECTION();
+            {
+                CT_REALTIME_SECTION();
+            }
+            expect(RealtimeGuard::isInRealtimeSection(), "thread stays marked until the outer section ends");
+        }
+        expect(!RealtimeGuard::isInRealtimeSection(), "thread is unmarked after the outer section");
+    }
+}
+
+int main() {
+    if (!RealtimeGuard::isEnabled()) {
+        std::cerr << "realtime guard not compiled in" << std::endl;
+        return 1;
+    }
+
+    allocationInsideSectionIsRecorded();
+    allocationOutsideSectionIsIgnored();
+    lockInsideSectionIsRecorded();
+    sectionsNest();
+
+    std::cout << (failures == 0 ? "all realtime guard checks passed" : "realtime guard checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
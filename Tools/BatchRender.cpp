@@ -0,0 +1,386 @@
+// Runs the detection and generation pipeline over folders of stems without a DAW. Built with
+// -DCOUNTERTUNE_BUILD_TOOLS=ON.
+//
+//   CounterTuneBatch <folder or file>... [--output-dir=dir] [--jobs=N] [--batch=32] [--bpm=140]
+//                    [--format=csv|binary] [--temperature=0.8] [--downmix=mid|left|right|<channel>]
+//
+// Multichannel files are folded to mono with the plugin's InputDownmix, mid unless --downmix says
+// otherwise, so a stereo stem gets the same pitch track here as through the plugin.
+//
+// Files are spread over one worker per job, each with its own detector and generator. A file is
+// streamed through PitchDetector in batched inferences, the frames go through the same
+// MelodyCapture the plugin uses on a sixteenth grid at the given tempo, and every completed
+// phrase gets a counter-melody. Per file this writes
+//
+//   <name>.pitch.csv / .pitch.bin   every analysed frame
+//   <name>.captured.mid             the captured phrases
+//   <name>.counter.mid              the counter-melodies, each one phrase later like in the plugin
+//
+// .pitch.bin is little endian: "CTPT", int32 version, float64 sample rate, int32 hop, int32 frame
+// size, int64 frame count, then per frame float32 frequency, float32 confidence, int64 end sample.
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "PitchDetector.h"
+#include "MelodyGenerator.h"
+#include "MelodyCapture.h"
+#include "MidiScheduler.h"
+#include "InputDownmix.h"
+
+namespace {
+
+    constexpr int phraseLength = 32;
+    constexpr int ticksPerQuarterNote = 960;
+    constexpr int ticksPerSlot = ticksPerQuarterNote / 4;
+    constexpr int readChunkSize = 1 << 16;
+
+    struct Settings {
+        juce::File outputDirectory;
+        int batchSize = 32;
+        double bpm = 140.0;
+        bool binaryPitchTrack = false;
+        float temperature = 0.8f;
+        InputDownmix::Mode downmix = InputDownmix::Mode::mid;
+        int downmixChannel = 0;
+    };
+
+    struct FileResult {
+        juce::File file;
+        bool ok = false;
+        juce::String error;
+        double audioSeconds = 0.0;
+        double wallSeconds = 0.0;
+        int numFrames = 0;
+        int numPhrases = 0;
+    };
+
+    //==============================================================================
+    class PitchTrackWriter {
+    public:
+        PitchTrackWriter(const juce::File& file, bool binaryFormat, double rate, int hopSize, int frameSize)
+            : binary(binaryFormat), sampleRate(rate) {
+            file.deleteFile();
+            stream = file.createOutputStream();
+            if (stream == nullptr) return;
+
+            if (binary) {
+                stream->write("CTPT", 4);
+                stream->writeInt(1);
+                stream->writeDouble(sampleRate);
+                stream->writeInt(hopSize);
+                stream->writeInt(frameSize);
+                countPosition = stream->getPosition();
+                stream->writeInt64(0); // patched in finish()
+            }
+            else {
+                *stream << "end_seconds,frequency_hz,confidence,midi_note\n";
+            }
+        }
+
+        bool isOpen() const { return stream != nullptr; }
+
+        void write(const PitchDetector::Frame& frame) {
+            if (binary) {
+                stream->writeFloat(frame.frequency);
+                stream->writeFloat(frame.confidence);
+                stream->writeInt64(frame.endSample);
+            }
+            else {
+                *stream << juce::String(frame.endSample / sampleRate, 5) << "," << juce::String(frame.frequency, 3) << ","
+                        << juce::String(frame.confidence, 4) << "," << juce::String(MelodyCapture::frequencyToMidiNote(frame.frequency)) << "\n";
+            }
+            ++count;
+        }
+
+        void finish() {
+            if (binary && stream->setPosition(countPosition))
+                stream->writeInt64(count);
+            stream->flush();
+        }
+
+    private:
+        std::unique_ptr<juce::FileOutputStream> stream;
+        bool binary;
+        double sampleRate;
+        juce::int64 countPosition = 0;
+        juce::int64 count = 0;
+    };
+
+    // Renders phrases through the plugin's own scheduler, one sixteenth per slot
+    bool writePhrasesAsMidi(const juce::File& file, const std::vector<std::array<int, phraseLength>>& phrases,
+                            int firstPhraseIndex, double bpm) {
+        juce::MidiMessageSequence track;
+        track.addEvent(juce::MidiMessage::tempoMetaEvent(juce::roundToInt(60.0e6 / bpm)), 0.0);
+
+        MidiScheduler scheduler;
+        juce::MidiBuffer slotEvents;
+        int tick = firstPhraseIndex * phraseLength * ticksPerSlot;
+
+        for (const auto& phrase : phrases) {
+            scheduler.loadPhrase(phrase.data(), phraseLength);
+            for (int slot = 0; slot < phraseLength; ++slot, tick += ticksPerSlot) {
+                slotEvents.clear();
+                scheduler.renderSlot(slot, 0, slotEvents);
+                for (const auto metadata : slotEvents)
+                    track.addEvent(metadata.getMessage(), tick);
+            }
+        }
+
+        slotEvents.clear();
+        scheduler.stopSounding(0, slotEvents);
+        for (const auto metadata : slotEvents)
+            track.addEvent(metadata.getMessage(), tick);
+
+        track.updateMatchedPairs();
+
+        juce::MidiFile midiFile;
+        midiFile.setTicksPerQuarterNote(ticksPerQuarterNote);
+        midiFile.addTrack(track);
+
+        file.deleteFile();
+        auto stream = file.createOutputStream();
+        return stream != nullptr && midiFile.writeTo(*stream);
+    }
+
+    //==============================================================================
+    class Worker : public juce::Thread {
+    public:
+        Worker(int index, const juce::Array<juce::File>& filesToRender, std::atomic<int>& nextFileIndex,
+               std::vector<FileResult>& resultsToFill, const Settings& renderSettings)
+            : juce::Thread("Batch Worker " + juce::String(index)), files(filesToRender), nextFile(nextFileIndex),
+              results(resultsToFill), settings(renderSettings) {
+            formatManager.registerBasicFormats();
+        }
+
+        bool initialize(juce::String& error) {
+            if (!detector.initialize(BinaryData::crepe_small_onnx, BinaryData::crepe_small_onnxSize)) {
+                error = "CREPE model didn't load";
+                return false;
+            }
+            if (!generator.initialize(BinaryData::melody_model_onnx, BinaryData::melody_model_onnxSize)) {
+                error = "melody model didn't load: " + juce::String(generator.getLastError());
+                return false;
+            }
+            return true;
+        }
+
+        void run() override {
+            for (int index = nextFile++; index < files.size() && !threadShouldExit(); index = nextFile++) {
+                auto& result = results[static_cast<size_t>(index)];
+                result.file = files[index];
+
+                const auto start = juce::Time::getHighResolutionTicks();
+                renderFile(result);
+                result.wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+                std::cout << (result.ok ? "done  " : "FAILED ") << result.file.getFileName() << "  "
+                          << (result.ok ? juce::String(result.audioSeconds / result.wallSeconds, 1) + "x realtime, "
+                                          + juce::String(result.numPhrases) + " phrases"
+                                        : result.error)
+                          << std::endl;
+            }
+        }
+
+    private:
+        const juce::Array<juce::File>& files;
+        std::atomic<int>& nextFile;
+        std::vector<FileResult>& results;
+        const Settings& settings;
+
+        juce::AudioFormatManager formatManager;
+        PitchDetector detector;
+        MelodyGenerator generator;
+
+        void renderFile(FileResult& result) {
+            std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(result.file));
+            if (reader == nullptr) {
+                result.error = "not a readable audio file";
+                return;
+            }
+
+            const double sampleRate = reader->sampleRate;
+            const int frameSize = detector.getFrameSize();
+            const int hop = frameSize; // the plugin's full-quality hop
+            const double samplesPerSlot = sampleRate * 60.0 / settings.bpm / 4.0;
+            detector.prepare(sampleRate);
+
+            const auto baseName = result.file.getFileNameWithoutExtension();
+            PitchTrackWriter pitchTrack(settings.outputDirectory.getChildFile(baseName + (settings.binaryPitchTrack ? ".pitch.bin" : ".pitch.csv")),
+                                        settings.binaryPitchTrack, sampleRate, hop, frameSize);
+            if (!pitchTrack.isOpen()) {
+                result.error = "couldn't write to " + settings.outputDirectory.getFullPathName();
+                return;
+            }
+
+            MelodyCapture capture(phraseLength);
+            std::vector<std::array<int, phraseLength>> capturedPhrases;
+            juce::int64 slotIndex = 0;
+
+            // The audio thread captures a slot from whatever frames were analysed by then; offline
+            // that's every frame ending on or before the slot boundary
+            const auto captureSlotsUpTo = [&](juce::int64 sample) {
+                for (; static_cast<juce::int64>(slotIndex * samplesPerSlot) < sample; ++slotIndex) {
+                    if (capture.captureSlot(static_cast<int>(slotIndex % phraseLength))) {
+                        std::array<int, phraseLength> phrase;
+                        std::copy(capture.getPhrase(), capture.getPhrase() + phraseLength, phrase.begin());
+                        capturedPhrases.push_back(phrase);
+                    }
+                }
+            };
+
+            // Stream the file: read a chunk, fold it to mono, analyse every whole frame, keep the
+            // overlap for later
+            const int numChannels = juce::jmax(1, static_cast<int>(reader->numChannels));
+            juce::AudioBuffer<float> chunk(numChannels, readChunkSize);
+            std::vector<float> mono(static_cast<size_t>(readChunkSize));
+            InputDownmix downmix;
+            downmix.setMode(settings.downmix, settings.downmixChannel);
+            std::vector<float> pending;
+            std::vector<PitchDetector::Frame> frames;
+            juce::int64 consumed = 0;
+
+            for (juce::int64 position = 0; position < reader->lengthInSamples; position += readChunkSize) {
+                const int numToRead = static_cast<int>(juce::jmin<juce::int64>(readChunkSize, reader->lengthInSamples - position));
+                reader->read(&chunk, 0, numToRead, position, true, true);
+                downmix.process(chunk, 0, numChannels, 0, numToRead, mono.data());
+                pending.insert(pending.end(), mono.data(), mono.data() + numToRead);
+
+                if (static_cast<int>(pending.size()) < frameSize) continue;
+                const int numFrames = (static_cast<int>(pending.size()) - frameSize) / hop + 1;
+
+                frames.clear();
+                detector.analyseFrames(pending.data(), numFrames, hop, settings.batchSize, frames);
+
+                for (auto frame : frames) {
+                    frame.endSample += consumed;
+                    pitchTrack.write(frame);
+                    captureSlotsUpTo(frame.endSample);
+                    capture.pushFrame(MelodyCapture::frequencyToMidiNote(frame.frequency), frame.confidence);
+                }
+                result.numFrames += static_cast<int>(frames.size());
+
+                pending.erase(pending.begin(), pending.begin() + static_cast<size_t>(numFrames) * hop);
+                consumed += static_cast<juce::int64>(numFrames) * hop;
+            }
+
+            captureSlotsUpTo(reader->lengthInSamples);
+            pitchTrack.finish();
+
+            // Same rule as the plugin: a phrase without notes is answered with silence
+            std::vector<std::array<int, phraseLength>> counterMelodies;
+            for (const auto& phrase : capturedPhrases) {
+                std::array<int, phraseLength> counter;
+                counter.fill(-2);
+                counter[0] = -1;
+
+                if (std::any_of(phrase.begin(), phrase.end(), [](int event) { return event >= 0; })) {
+                    std::vector<int> events(phrase.begin(), phrase.end());
+                    const auto generated = generator.generateMelody(events, settings.temperature, phraseLength);
+                    std::copy_n(generated.begin(), juce::jmin<size_t>(generated.size(), phraseLength), counter.begin());
+                }
+                counterMelodies.push_back(counter);
+            }
+
+            if (!writePhrasesAsMidi(settings.outputDirectory.getChildFile(baseName + ".captured.mid"), capturedPhrases, 0, settings.bpm)
+                || !writePhrasesAsMidi(settings.outputDirectory.getChildFile(baseName + ".counter.mid"), counterMelodies, 1, settings.bpm)) {
+                result.error = "couldn't write the MIDI files";
+                return;
+            }
+
+            result.audioSeconds = reader->lengthInSamples / sampleRate;
+            result.numPhrases = static_cast<int>(capturedPhrases.size());
+            result.ok = true;
+        }
+    };
+
+    juce::Array<juce::File> collectInputFiles(const juce::ArgumentList& args) {
+        juce::Array<juce::File> files;
+        for (const auto& argument : args.arguments) {
+            if (argument.isOption()) continue;
+
+            const auto path = argument.resolveAsFile();
+            if (path.isDirectory()) {
+                for (const auto& file : path.findChildFiles(juce::File::findFiles, true, "*.wav;*.aif;*.aiff"))
+                    files.add(file);
+            }
+            else if (path.existsAsFile()) {
+                files.add(path);
+            }
+        }
+        return files;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const juce::ArgumentList args(argc, argv);
+
+    const auto files = collectInputFiles(args);
+    if (files.isEmpty()) {
+        std::cerr << "usage: CounterTuneBatch <folder or file>... [--output-dir=dir] [--jobs=N] [--batch=32] [--bpm=140]"
+                     " [--format=csv|binary] [--temperature=0.8] [--downmix=mid|left|right|<channel>]" << std::endl;
+        return 1;
+    }
+
+    Settings settings;
+    settings.outputDirectory = args.containsOption("--output-dir")
+        ? juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output-dir"))
+        : juce::File::getCurrentWorkingDirectory().getChildFile("countertune_out");
+    if (args.containsOption("--batch"))       settings.batchSize = juce::jmax(1, args.getValueForOption("--batch").getIntValue());
+    if (args.containsOption("--bpm"))         settings.bpm = juce::jlimit(20.0, 400.0, args.getValueForOption("--bpm").getDoubleValue());
+    if (args.containsOption("--temperature")) settings.temperature = args.getValueForOption("--temperature").getFloatValue();
+    settings.binaryPitchTrack = args.getValueForOption("--format") == "binary";
+    if (args.containsOption("--downmix")) {
+        const auto mode = args.getValueForOption("--downmix");
+        if (mode == "left")       settings.downmix = InputDownmix::Mode::left;
+        else if (mode == "right") settings.downmix = InputDownmix::Mode::right;
+        else if (mode != "mid") {
+            settings.downmix = InputDownmix::Mode::channel;
+            settings.downmixChannel = juce::jmax(0, mode.getIntValue());
+        }
+    }
+
+    if (!settings.outputDirectory.createDirectory().wasOk()) {
+        std::cerr << "Couldn't create " << settings.outputDirectory.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    const int numJobs = juce::jlimit(1, files.size(), args.containsOption("--jobs")
+        ? args.getValueForOption("--jobs").getIntValue()
+        : juce::SystemStats::getNumPhysicalCpus());
+
+    std::vector<FileResult> results(static_cast<size_t>(files.size()));
+    std::atomic<int> nextFile{ 0 };
+
+    juce::OwnedArray<Worker> workers;
+    for (int i = 0; i < numJobs; ++i) {
+        auto* worker = workers.add(new Worker(i, files, nextFile, results, settings));
+        juce::String error;
+        if (!worker->initialize(error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << files.size() << " files on " << numJobs << " workers" << std::endl;
+    const auto start = juce::Time::getHighResolutionTicks();
+
+    for (auto* worker : workers)
+        worker->startThread();
+    for (auto* worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    const double wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+    double audioSeconds = 0.0;
+    int failed = 0;
+    for (const auto& result : results) {
+        audioSeconds += result.audioSeconds;
+        failed += result.ok ? 0 : 1;
+    }
+
+    std::cout << "\n" << juce::String(audioSeconds, 1) << " s of audio in " << juce::String(wallSeconds, 1) << " s, "
+              << juce::String(wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0, 1) << "x realtime"
+              << (failed > 0 ? ", " + juce::String(failed) + " files failed" : juce::String()) << std::endl;
+
+    return failed > 0 ? 2 : 0;
+}
@@ -0,0 +1,398 @@
+// How many CounterTuneIO instances does this machine carry? Built with -DCOUNTERTUNE_BUILD_TOOLS=ON.
+//
+//   CounterTuneLoadTest [--instances=1,2,4,8,16] [--block-sizes=32,64,...,2048] [--sample-rate=48000]
+//                       [--seconds=10] [--threads=N] [--input=vocals.wav] [--as-fast-as-possible]
+//                       [--output=report.json] [--fail-on-violation]
+//
+// For every block size and instance count a fresh set of processors is prepared and driven from a
+// pool of simulated audio threads, each owning a share of the instances and paced like a real
+// device callback. The input is the given recording, or a synthetic sung line when there's none.
+// A cycle misses its deadline when a thread can't get through its instances in one block period.
+//
+// Instance counts stop growing for a block size once a run misses more than 1% of its deadlines.
+// --fail-on-violation exits with 2 when the realtime guard caught anything on the audio threads,
+// and with 1 when the models didn't load and there was nothing worth checking.
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "PluginProcessor.h"
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/resource.h>
+#endif
+
+namespace {
+
+    struct Options {
+        std::vector<int> instanceCounts{ 1, 2, 4, 8, 16, 32 };
+        std::vector<int> blockSizes{ 32, 64, 128, 256, 512, 1024, 2048 };
+        double sampleRate = 48000.0;
+        double seconds = 10.0;
+        int numThreads = juce::jmax(1, juce::SystemStats::getNumPhysicalCpus() / 2);
+        bool realtimePacing = true;
+        bool failOnViolation = false;
+        juce::File inputFile;
+        juce::File outputFile;
+    };
+
+    std::vector<int> parseIntList(const juce::String& text) {
+        std::vector<int> values;
+        for (const auto& token : juce::StringArray::fromTokens(text, ",", ""))
+            if (token.getIntValue() > 0)
+                values.push_back(token.getIntValue());
+        return values;
+    }
+
+    //==============================================================================
+    double getProcessCpuSeconds() {
+       #if JUCE_LINUX || JUCE_MAC
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0e-6;
+       #else
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+       #endif
+    }
+
+    // Resident set size, 0 where there's no cheap way to ask
+    juce::int64 getResidentBytes() {
+       #if JUCE_LINUX
+        const auto fields = juce::StringArray::fromTokens(juce::File("/proc/self/statm").loadFileAsString(), " ", "");
+        return fields.size() > 1 ? fields[1].getLargeIntValue() * 4096 : 0;
+       #else
+        return 0;
+       #endif
+    }
+
+    //==============================================================================
+    // A sung line: notes from a major scale with vibrato, a few harmonics, breaths between phrases
+    juce::AudioBuffer<float> createSyntheticVocal(double sampleRate, double seconds) {
+        const int numSamples = static_cast<int>(sampleRate * seconds);
+        juce::AudioBuffer<float> vocal(1, numSamples);
+        auto* out = vocal.getWritePointer(0);
+
+        const int scale[] = { 0, 2, 4, 5, 7, 9, 11, 12 };
+        juce::Random random(71);
+        double phase = 0.0, vibratoPhase = 0.0;
+        int noteSamplesLeft = 0;
+        double frequency = 0.0;
+
+        for (int i = 0; i < numSamples; ++i) {
+            if (noteSamplesLeft-- <= 0) {
+                // one note in six is a breath
+                const bool rest = random.nextInt(6) == 0;
+                frequency = rest ? 0.0 : juce::MidiMessage::getMidiNoteInHertz(57 + scale[random.nextInt(8)]);
+                noteSamplesLeft = static_cast<int>(sampleRate * (0.2 + 0.3 * random.nextFloat()));
+            }
+
+            float sample = 0.0f;
+            if (frequency > 0.0) {
+                vibratoPhase += juce::MathConstants<double>::twoPi * 5.5 / sampleRate;
+                const double vibrato = std::pow(2.0, 0.3 * std::sin(vibratoPhase) / 12.0);
+                phase += juce::MathConstants<double>::twoPi * frequency * vibrato / sampleRate;
+
+                sample = static_cast<float>(0.4 * std::sin(phase) + 0.15 * std::sin(2.0 * phase) + 0.08 * std::sin(3.0 * phase));
+            }
+            out[i] = sample + 0.002f * (random.nextFloat() - 0.5f);
+        }
+
+        return vocal;
+    }
+
+    bool loadVocal(const juce::File& file, double sampleRate, juce::AudioBuffer<float>& vocal) {
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+        if (reader == nullptr) return false;
+
+        juce::AudioBuffer<float> fileAudio(1, static_cast<int>(reader->lengthInSamples));
+        reader->read(&fileAudio, 0, fileAudio.getNumSamples(), 0, true, false);
+
+        // brought to the test's sample rate so the pitch path sees what a host would feed it
+        const double ratio = reader->sampleRate / sampleRate;
+        vocal.setSize(1, static_cast<int>(fileAudio.getNumSamples() / ratio));
+        juce::LagrangeInterpolator interpolator;
+        interpolator.process(ratio, fileAudio.getReadPointer(0), vocal.getWritePointer(0), vocal.getNumSamples());
+        return true;
+    }
+
+    //==============================================================================
+    struct Instance {
+        std::unique_ptr<CounterTuneIOAudioProcessor> processor;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        int readPosition = 0;
+    };
+
+    // One simulated device callback thread, processes its instances back to back every block period
+    class AudioThread : public juce::Thread {
+    public:
+        AudioThread(int index, const juce::AudioBuffer<float>& source, int samplesPerBlock, double rate, int blocks, bool pace)
+            : juce::Thread("Simulated Audio " + juce::String(index)), vocal(source),
+              blockSize(samplesPerBlock), sampleRate(rate), numBlocks(blocks), realtimePacing(pace) {}
+
+        void addInstance(Instance& instance) { instances.push_back(&instance); }
+
+        void start(juce::int64 startTicks) {
+            firstDeadlineTicks = startTicks;
+            startThread(juce::Thread::Priority::highest);
+        }
+
+        void run() override {
+            const auto ticksPerBlock = static_cast<juce::int64>(juce::Time::getHighResolutionTicksPerSecond() * blockSize / sampleRate);
+            auto deadline = firstDeadlineTicks;
+
+            for (int block = 0; block < numBlocks && !threadShouldExit(); ++block) {
+                deadline += ticksPerBlock;
+                const auto cycleStart = juce::Time::getHighResolutionTicks();
+
+                for (auto* instance : instances)
+                    processInstance(*instance);
+
+                const auto cycleEnd = juce::Time::getHighResolutionTicks();
+                busyTicks += cycleEnd - cycleStart;
+                if (cycleEnd > deadline)
+                    ++missedDeadlines;
+
+                if (realtimePacing) {
+                    // a late cycle pushes the next deadline back, like a device after an xrun
+                    if (cycleEnd > deadline)
+                        deadline = cycleEnd;
+                    else
+                        while (juce::Time::getHighResolutionTicks() < deadline)
+                            juce::Thread::sleep(juce::jmax(0, static_cast<int>(juce::Time::highResolutionTicksToSeconds(deadline - juce::Time::getHighResolutionTicks()) * 1000.0) - 1));
+                }
+            }
+        }
+
+        juce::int64 busyTicks = 0;
+        int missedDeadlines = 0;
+
+    private:
+        const juce::AudioBuffer<float>& vocal;
+        std::vector<Instance*> instances;
+        int blockSize;
+        double sampleRate;
+        int numBlocks;
+        bool realtimePacing;
+        juce::int64 firstDeadlineTicks = 0;
+
+        void processInstance(Instance& instance) {
+            // the vocal loops, both channels get the same signal
+            for (int done = 0; done < blockSize;) {
+                const int chunk = juce::jmin(blockSize - done, vocal.getNumSamples() - instance.readPosition);
+                for (int ch = 0; ch < instance.buffer.getNumChannels(); ++ch)
+                    instance.buffer.copyFrom(ch, done, vocal, 0, instance.readPosition, chunk);
+                done += chunk;
+                instance.readPosition = (instance.readPosition + chunk) % vocal.getNumSamples();
+            }
+
+            instance.midi.clear();
+            instance.processor->processBlock(instance.buffer, instance.midi);
+        }
+    };
+
+    //==============================================================================
+    struct RunResult {
+        int blockSize = 0;
+        int instances = 0;
+        double audioCpuPerInstance = 0.0;    // share of one core the audio threads spent per instance
+        double processCpuPerInstance = 0.0;  // everything, pitch and generation threads included
+        int cycles = 0;
+        int missedCycles = 0;
+        juce::uint64 blockOverruns = 0;      // single processBlock calls over their own budget
+        juce::uint64 droppedSamples = 0;
+        double pitchLatencyP50Ms = 0.0;
+        double pitchLatencyP99Ms = 0.0;
+        double memoryPerInstanceMB = 0.0;
+        juce::uint64 realtimeViolations = 0;
+        bool modelsReady = true;
+
+        double getMissRatio() const { return cycles > 0 ? static_cast<double>(missedCycles) / cycles : 0.0; }
+    };
+
+    RunResult runLoad(const Options& options, const juce::AudioBuffer<float>& vocal, int blockSize, int numInstances) {
+        RunResult result;
+        result.blockSize = blockSize;
+        result.instances = numInstances;
+
+        const auto residentBefore = getResidentBytes();
+
+        std::vector<Instance> instances(static_cast<size_t>(numInstances));
+        for (auto& instance : instances) {
+            instance.processor = std::make_unique<CounterTuneIOAudioProcessor>();
+            instance.processor->setRateAndBufferSizeDetails(options.sampleRate, blockSize);
+            instance.processor->prepareToPlay(options.sampleRate, blockSize);
+            instance.buffer.setSize(2, blockSize);
+            instance.midi.ensureSize(256);
+        }
+
+        // models load on the instances' own threads, measuring before that would flatter the numbers
+        const auto loadTimeout = juce::Time::getMillisecondCounter() + 120000;
+        for (auto& instance : instances)
+            while (!(instance.processor->isPitchDetectorReady() && instance.processor->isGeneratorReady())
+                   && juce::Time::getMillisecondCounter() < loadTimeout)
+                juce::Thread::sleep(10);
+
+        for (auto& instance : instances)
+            result.modelsReady = result.modelsReady && instance.processor->isPitchDetectorReady() && instance.processor->isGeneratorReady();
+
+        const auto residentLoaded = getResidentBytes();
+        result.memoryPerInstanceMB = static_cast<double>(residentLoaded - residentBefore) / numInstances / (1024.0 * 1024.0);
+
+        const int numBlocks = static_cast<int>(options.seconds * options.sampleRate / blockSize);
+        const int numThreads = juce::jmin(options.numThreads, numInstances);
+
+        juce::OwnedArray<AudioThread> threads;
+        for (int t = 0; t < numThreads; ++t)
+            threads.add(new AudioThread(t, vocal, blockSize, options.sampleRate, numBlocks, options.realtimePacing));
+        for (int i = 0; i < numInstances; ++i)
+            threads[i % numThreads]->addInstance(instances[static_cast<size_t>(i)]);
+
+        RealtimeGuard::resetViolations();
+        const double cpuBefore = getProcessCpuSeconds();
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+
+        for (auto* thread : threads)
+            thread->start(startTicks);
+        for (auto* thread : threads)
+            thread->waitForThreadToExit(-1);
+
+        const double wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+        const double cpuSeconds = getProcessCpuSeconds() - cpuBefore;
+        result.realtimeViolations = RealtimeGuard::getViolationCount();
+
+        juce::int64 busyTicks = 0;
+        for (auto* thread : threads) {
+            busyTicks += thread->busyTicks;
+            result.missedCycles += thread->missedDeadlines;
+        }
+        result.cycles = numBlocks * numThreads;
+        result.audioCpuPerInstance = juce::Time::highResolutionTicksToSeconds(busyTicks) / wallSeconds / numInstances;
+        result.processCpuPerInstance = cpuSeconds / wallSeconds / numInstances;
+
+        for (auto& instance : instances) {
+            const auto& metrics = instance.processor->getPerformanceMetrics();
+            const auto latency = metrics.pitchLatency.getSummary();
+            result.blockOverruns += metrics.getMissedDeadlines();
+            result.droppedSamples += metrics.getDroppedSamples();
+            result.pitchLatencyP50Ms += latency.p50Ms / numInstances;
+            result.pitchLatencyP99Ms = juce::jmax(result.pitchLatencyP99Ms, latency.p99Ms);
+        }
+
+        for (auto& instance : instances)
+            instance.processor->releaseResources();
+
+        return result;
+    }
+
+    juce::var toJson(const RunResult& r) {
+        auto* row = new juce::DynamicObject();
+        row->setProperty("blockSize", r.blockSize);
+        row->setProperty("instances", r.instances);
+        row->setProperty("audioCpuPerInstance", r.audioCpuPerInstance);
+        row->setProperty("processCpuPerInstance", r.processCpuPerInstance);
+        row->setProperty("cycles", r.cycles);
+        row->setProperty("missedCycles", r.missedCycles);
+        row->setProperty("blockOverruns", static_cast<juce::int64>(r.blockOverruns));
+        row->setProperty("droppedSamples", static_cast<juce::int64>(r.droppedSamples));
+        row->setProperty("pitchLatencyP50Ms", r.pitchLatencyP50Ms);
+        row->setProperty("pitchLatencyP99Ms", r.pitchLatencyP99Ms);
+        row->setProperty("memoryPerInstanceMB", r.memoryPerInstanceMB);
+        row->setProperty("realtimeViolations", static_cast<juce::int64>(r.realtimeViolations));
+        row->setProperty("modelsReady", r.modelsReady);
+        return juce::var(row);
+    }
+
+    void printRow(const RunResult& r) {
+        std::cout << juce::String(r.blockSize).paddedLeft(' ', 6)
+                  << juce::String(r.instances).paddedLeft(' ', 6)
+                  << juce::String(r.audioCpuPerInstance * 100.0, 2).paddedLeft(' ', 10) << "%"
+                  << juce::String(r.processCpuPerInstance * 100.0, 2).paddedLeft(' ', 10) << "%"
+                  << juce::String(r.missedCycles).paddedLeft(' ', 8) << "/" << r.cycles
+                  << juce::String(r.pitchLatencyP50Ms, 1).paddedLeft(' ', 9)
+                  << juce::String(r.pitchLatencyP99Ms, 1).paddedLeft(' ', 9)
+                  << juce::String(r.memoryPerInstanceMB, 1).paddedLeft(' ', 9)
+                  << juce::String(static_cast<juce::int64>(r.realtimeViolations)).paddedLeft(' ', 8)
+                  << (r.modelsReady ? "" : "  (models not ready)") << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    const juce::ArgumentList args(argc, argv);
+
+    Options options;
+    if (args.containsOption("--instances"))   options.instanceCounts = parseIntList(args.getValueForOption("--instances"));
+    if (args.containsOption("--block-sizes")) options.blockSizes = parseIntList(args.getValueForOption("--block-sizes"));
+    if (args.containsOption("--sample-rate")) options.sampleRate = args.getValueForOption("--sample-rate").getDoubleValue();
+    if (args.containsOption("--seconds"))     options.seconds = args.getValueForOption("--seconds").getDoubleValue();
+    if (args.containsOption("--threads"))     options.numThreads = juce::jmax(1, args.getValueForOption("--threads").getIntValue());
+    options.realtimePacing = !args.containsOption("--as-fast-as-possible");
+    options.failOnViolation = args.containsOption("--fail-on-violation");
+    if (args.containsOption("--output"))      options.outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+    if (args.containsOption("--input"))       options.inputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--input"));
+
+    juce::AudioBuffer<float> vocal;
+    if (options.inputFile != juce::File()) {
+        if (!loadVocal(options.inputFile, options.sampleRate, vocal)) {
+            std::cerr << "Couldn't read " << options.inputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+    else {
+        vocal = createSyntheticVocal(options.sampleRate, 30.0);
+    }
+
+    if (!RealtimeGuard::isEnabled())
+        std::cout << "Realtime guard not compiled in, violations read 0 (debug build or -DCOUNTERTUNE_REALTIME_GUARD=ON)" << std::endl;
+
+    std::cout << " block  inst  audio cpu  total cpu    missed    p50 ms   p99 ms   MB/inst  rt viol" << std::endl;
+
+    juce::Array<juce::var> rows;
+    juce::uint64 totalViolations = 0;
+    bool allModelsReady = true;
+
+    for (const int blockSize : options.blockSizes) {
+        for (const int numInstances : options.instanceCounts) {
+            const auto result = runLoad(options, vocal, blockSize, numInstances);
+            printRow(result);
+            rows.add(toJson(result));
+            totalViolations += result.realtimeViolations;
+            allModelsReady = allModelsReady && result.modelsReady;
+
+            if (result.getMissRatio() > 0.01)
+                break;
+        }
+    }
+
+    if (options.outputFile != juce::File()) {
+        auto* root = new juce::DynamicObject();
+        root->setProperty("sampleRate", options.sampleRate);
+        root->setProperty("seconds", options.seconds);
+        root->setProperty("threads", options.numThreads);
+        root->setProperty("realtimePacing", options.realtimePacing);
+        root->setProperty("cpu", juce::SystemStats::getCpuModel());
+        root->setProperty("runs", rows);
+
+        if (!options.outputFile.replaceWithText(juce::JSON::toString(juce::var(root)))) {
+            std::cerr << "Couldn't write " << options.outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    // without the models most of processBlock never runs, a clean run would prove nothing
+    if (options.failOnViolation && !allModelsReady) {
+        std::cerr << "Models didn't load, the audio thread wasn't checked" << std::endl;
+        return 1;
+    }
+
+    if (totalViolations > 0) {
+        std::cout << "\nAudio thread violations:\n" << RealtimeGuard::describeViolations() << std::endl;
+        if (options.failOnViolation)
+            return 2;
+    }
+
+    return 0;
+}
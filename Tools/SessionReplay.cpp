@@ -0,0 +1,337 @@
+// Replays a session captured from the plugin editor (CAPTURE SESSION) through processBlock,
+// headless and deterministic. Built with -DCOUNTERTUNE_BUILD_TOOLS=ON.
+//
+//   CounterTuneReplay <session.ctsc> [--golden=golden.json] [--update-golden]
+//                     [--baseline=baseline.json] [--update-baseline] [--threshold=0.25]
+//                     [--runs=3] [--output=report.json]
+//
+// The processor runs non-realtime: pitch frames and counter-melodies are computed inside
+// processBlock on the full model with the capture's seed, so the pitch track, every captured
+// phrase and every generated phrase only depend on the capture. They are checked exactly against
+// the golden file. Latency percentiles (best of all runs) are checked against the baseline and
+// fail when they grow by more than the threshold. --update-* writes the files instead.
+//
+// Exit codes: 0 pass, 1 usage or load error, 2 output differs from golden, 3 latency regression.
+// The golden output comes from a replay, a live session analyses on its own thread timing and
+// won't match it frame for frame.
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "PluginProcessor.h"
+
+namespace {
+
+    constexpr double absoluteSlackMs = 0.05;  // below this a difference is histogram resolution, not a regression
+
+    struct ReplayOutput {
+        std::vector<PitchDetector::Frame> pitchTrack;
+        std::vector<std::vector<int>> capturedPhrases;
+        std::vector<std::vector<int>> generatedPhrases;
+    };
+
+    // the histograms the replay exercises, pitchLatency only exists on the realtime path
+    const char* const latencyMetrics[] = { "blockDuration", "pitchInference", "generationLatency" };
+
+    const LatencyHistogram& getHistogram(const PerformanceMetrics& metrics, const juce::String& name) {
+        if (name == "pitchInference") return metrics.pitchInference;
+        if (name == "generationLatency") return metrics.generationLatency;
+        return metrics.blockDuration;
+    }
+
+    class ReplayPlayHead : public juce::AudioPlayHead {
+    public:
+        juce::Optional<PositionInfo> getPosition() const override { return position; }
+        juce::Optional<PositionInfo> position;
+    };
+
+    //==============================================================================
+    // FNV-1a over end sample and the exact bits of frequency and confidence
+    juce::String hashPitchTrack(const std::vector<PitchDetector::Frame>& track) {
+        juce::uint64 hash = 0xcbf29ce484222325ull;
+        const auto add = [&hash](const void* data, size_t numBytes) {
+            for (size_t i = 0; i < numBytes; ++i) {
+                hash ^= static_cast<const juce::uint8*>(data)[i];
+                hash *= 0x100000001b3ull;
+            }
+        };
+
+        for (const auto& frame : track) {
+            add(&frame.endSample, sizeof(frame.endSample));
+            add(&frame.frequency, sizeof(frame.frequency));
+            add(&frame.confidence, sizeof(frame.confidence));
+        }
+        return juce::String::toHexString(static_cast<juce::int64>(hash));
+    }
+
+    juce::var phrasesToVar(const std::vector<std::vector<int>>& phrases) {
+        juce::Array<juce::var> list;
+        for (const auto& phrase : phrases) {
+            juce::Array<juce::var> events;
+            for (const int event : phrase)
+                events.add(event);
+            list.add(juce::var(events));
+        }
+        return juce::var(list);
+    }
+
+    std::vector<std::vector<int>> phrasesFromVar(const juce::var& list) {
+        std::vector<std::vector<int>> phrases;
+        if (const auto* array = list.getArray()) {
+            for (const auto& events : *array) {
+                phrases.emplace_back();
+                if (const auto* eventArray = events.getArray())
+                    for (const auto& event : *eventArray)
+                        phrases.back().push_back(static_cast<int>(event));
+            }
+        }
+        return phrases;
+    }
+
+    juce::var outputToJson(const ReplayOutput& output, const SessionCapture::Capture& capture) {
+        auto* root = new juce::DynamicObject();
+        root->setProperty("seed", static_cast<juce::int64>(capture.header.seed));
+        root->setProperty("blocks", static_cast<int>(capture.blocks.size()));
+        root->setProperty("pitchFrames", static_cast<int>(output.pitchTrack.size()));
+        root->setProperty("pitchTrackHash", hashPitchTrack(output.pitchTrack));
+        root->setProperty("capturedPhrases", phrasesToVar(output.capturedPhrases));
+        root->setProperty("generatedPhrases", phrasesToVar(output.generatedPhrases));
+        return juce::var(root);
+    }
+
+    // Empty when they match, otherwise what differs first
+    juce::String compareOutputs(const juce::var& expected, const juce::var& actual) {
+        if (expected["pitchTrackHash"].toString() != actual["pitchTrackHash"].toString())
+            return "pitch track differs (" + expected["pitchFrames"].toString() + " frames expected, "
+                + actual["pitchFrames"].toString() + " replayed)";
+
+        for (const auto* key : { "capturedPhrases", "generatedPhrases" }) {
+            const auto expectedPhrases = phrasesFromVar(expected[key]);
+            const auto actualPhrases = phrasesFromVar(actual[key]);
+
+            const auto count = juce::jmin(expectedPhrases.size(), actualPhrases.size());
+            for (size_t i = 0; i < count; ++i)
+                if (expectedPhrases[i] != actualPhrases[i])
+                    return juce::String(key) + " differ from phrase " + juce::String(static_cast<int>(i)) + " on";
+
+            if (expectedPhrases.size() != actualPhrases.size())
+                return juce::String(key) + ": " + juce::String(static_cast<int>(expectedPhrases.size())) + " expected, "
+                    + juce::String(static_cast<int>(actualPhrases.size())) + " replayed";
+        }
+        return {};
+    }
+
+    //==============================================================================
+    bool replay(const SessionCapture::Capture& capture, ReplayOutput& output, juce::var& latencies, juce::String& error) {
+        const auto& header = capture.header;
+
+        CounterTuneIOAudioProcessor processor;
+        ReplayPlayHead playHead;
+        processor.setPlayHead(&playHead);
+        processor.setNonRealtime(true);
+        processor.setRandomSeed(header.seed);
+        processor.setInputDownmix(header.downmixMode, header.downmixChannel);
+        processor.setKeyConstraint(header.keyConstraint);
+        processor.setSampleSlot(header.sampleSlot);
+        processor.setFallbackTempo(header.fallbackBpm);
+        processor.setPitchFrameListener([&output](const PitchDetector::Frame& frame) { output.pitchTrack.push_back(frame); });
+        processor.setRateAndBufferSizeDetails(header.sampleRate, header.maxBlockSize);
+        processor.prepareToPlay(header.sampleRate, header.maxBlockSize);
+
+        // frames only get analysed once the models are in, wait rather than replay into nothing
+        const auto loadTimeout = juce::Time::getMillisecondCounter() + 120000;
+        while (!(processor.isPitchDetectorReady() && processor.isGeneratorReady())
+               && juce::Time::getMillisecondCounter() < loadTimeout)
+            juce::Thread::sleep(10);
+
+        if (!(processor.isPitchDetectorReady() && processor.isGeneratorReady())) {
+            error = "models didn't load";
+            return false;
+        }
+
+        // the capture only holds the main bus, a mono one fills both channels of the stereo input
+        const int numChannels = juce::jmax(2, header.numChannels);
+        juce::AudioBuffer<float> buffer(numChannels, header.maxBlockSize);
+        juce::MidiBuffer midi;
+        midi.ensureSize(256);
+
+        auto capturedVersion = processor.getCapturedMelodyVersion();
+        auto generatedVersion = processor.getGeneratedMelodyVersion();
+
+        for (const auto& block : capture.blocks) {
+            const int numSamples = block.info.numSamples;
+            buffer.setSize(numChannels, numSamples, false, false, true);
+            for (int ch = 0; ch < numChannels; ++ch)
+                buffer.copyFrom(ch, 0, capture.getChannel(block, juce::jmin(ch, header.numChannels - 1)), numSamples);
+
+            playHead.position = block.info.toPosition();
+            processor.processBlock(buffer, midi);
+            midi.clear();
+
+            if (processor.getCapturedMelodyVersion() != capturedVersion) {
+                capturedVersion = processor.getCapturedMelodyVersion();
+                output.capturedPhrases.push_back(processor.getCapturedMelody());
+            }
+            if (processor.getGeneratedMelodyVersion() != generatedVersion) {
+                generatedVersion = processor.getGeneratedMelodyVersion();
+                output.generatedPhrases.push_back(processor.getGeneratedMelody());
+            }
+        }
+
+        auto* root = new juce::DynamicObject();
+        for (const auto* name : latencyMetrics) {
+            const auto summary = getHistogram(processor.getPerformanceMetrics(), name).getSummary();
+            auto* entry = new juce::DynamicObject();
+            entry->setProperty("count", static_cast<juce::int64>(summary.count));
+            entry->setProperty("p50Ms", summary.p50Ms);
+            entry->setProperty("p99Ms", summary.p99Ms);
+            root->setProperty(name, juce::var(entry));
+        }
+        latencies = juce::var(root);
+
+        processor.releaseResources();
+        processor.setPlayHead(nullptr);
+        return true;
+    }
+
+    // Keeps the lower of each percentile, the fastest run is the one least disturbed by the machine
+    void keepBest(juce::var& best, const juce::var& latencies) {
+        if (best.isVoid()) {
+            best = latencies;
+            return;
+        }
+
+        for (const auto* name : latencyMetrics)
+            for (const auto* percentile : { "p50Ms", "p99Ms" })
+                if (auto* entry = best[name].getDynamicObject())
+                    entry->setProperty(percentile, juce::jmin(static_cast<double>(best[name][percentile]),
+                                                              static_cast<double>(latencies[name][percentile])));
+    }
+
+    // One line per regressed percentile, empty when everything is within the threshold
+    juce::StringArray findRegressions(const juce::var& baseline, const juce::var& latencies, double threshold) {
+        juce::StringArray regressions;
+        for (const auto* name : latencyMetrics) {
+            for (const auto* percentile : { "p50Ms", "p99Ms" }) {
+                if (!baseline[name].hasProperty(percentile)) continue;
+
+                const double expected = baseline[name][percentile];
+                const double actual = latencies[name][percentile];
+                if (actual > expected * (1.0 + threshold) && actual - expected > absoluteSlackMs)
+                    regressions.add(juce::String(name) + " " + percentile + ": " + juce::String(actual, 3)
+                                    + " ms vs baseline " + juce::String(expected, 3) + " ms");
+            }
+        }
+        return regressions;
+    }
+
+    juce::File resolve(const juce::ArgumentList& args, const juce::String& option) {
+        return args.containsOption(option) ? juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption(option))
+                                           : juce::File();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    const juce::ArgumentList args(argc, argv);
+
+    if (args.size() < 1 || args[0].isOption()) {
+        std::cerr << "usage: CounterTuneReplay <session.ctsc> [--golden=file] [--update-golden] [--baseline=file]"
+                     " [--update-baseline] [--threshold=0.25] [--runs=3] [--output=file]" << std::endl;
+        return 1;
+    }
+
+    const auto captureFile = args[0].resolveAsExistingFile();
+    const auto goldenFile = resolve(args, "--golden");
+    const auto baselineFile = resolve(args, "--baseline");
+    const auto outputFile = resolve(args, "--output");
+    const double threshold = args.containsOption("--threshold") ? args.getValueForOption("--threshold").getDoubleValue() : 0.25;
+    const int runs = args.containsOption("--runs") ? juce::jmax(1, args.getValueForOption("--runs").getIntValue()) : 3;
+
+    SessionCapture::Capture capture;
+    juce::String error;
+    if (!capture.load(captureFile, error)) {
+        std::cerr << captureFile.getFullPathName() << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "Replaying " << captureFile.getFileName() << ": " << static_cast<int>(capture.blocks.size()) << " blocks, "
+              << juce::String(capture.getLengthSeconds(), 1) << " s at " << capture.header.sampleRate << " Hz, seed "
+              << static_cast<juce::int64>(capture.header.seed) << std::endl;
+
+    juce::var firstOutput, bestLatencies;
+    for (int run = 0; run < runs; ++run) {
+        ReplayOutput output;
+        juce::var latencies;
+        if (!replay(capture, output, latencies, error)) {
+            std::cerr << "Replay failed: " << error << std::endl;
+            return 1;
+        }
+
+        const auto json = outputToJson(output, capture);
+        if (run == 0) {
+            firstOutput = json;
+        }
+        else {
+            // a replay that disagrees with itself would make any golden file meaningless
+            const auto difference = compareOutputs(firstOutput, json);
+            if (difference.isNotEmpty()) {
+                std::cerr << "Run " << run + 1 << " isn't deterministic: " << difference << std::endl;
+                return 2;
+            }
+        }
+        keepBest(bestLatencies, latencies);
+    }
+
+    std::cout << "Pitch frames " << firstOutput["pitchFrames"].toString() << ", captured phrases "
+              << static_cast<int>(phrasesFromVar(firstOutput["capturedPhrases"]).size()) << ", generated phrases "
+              << static_cast<int>(phrasesFromVar(firstOutput["generatedPhrases"]).size()) << std::endl;
+
+    for (const auto* name : latencyMetrics)
+        std::cout << juce::String(name).paddedRight(' ', 20) << "p50 " << juce::String(static_cast<double>(bestLatencies[name]["p50Ms"]), 3)
+                  << " ms   p99 " << juce::String(static_cast<double>(bestLatencies[name]["p99Ms"]), 3) << " ms" << std::endl;
+
+    int exitCode = 0;
+
+    if (goldenFile != juce::File()) {
+        if (args.containsOption("--update-golden")) {
+            goldenFile.replaceWithText(juce::JSON::toString(firstOutput));
+            std::cout << "Golden output written to " << goldenFile.getFullPathName() << std::endl;
+        }
+        else {
+            const auto difference = compareOutputs(juce::JSON::parse(goldenFile), firstOutput);
+            if (difference.isNotEmpty()) {
+                std::cerr << "FAIL output: " << difference << std::endl;
+                exitCode = 2;
+            }
+            else {
+                std::cout << "Output matches " << goldenFile.getFileName() << std::endl;
+            }
+        }
+    }
+
+    if (baselineFile != juce::File()) {
+        if (args.containsOption("--update-baseline")) {
+            baselineFile.replaceWithText(juce::JSON::toString(bestLatencies));
+            std::cout << "Latency baseline written to " << baselineFile.getFullPathName() << std::endl;
+        }
+        else {
+            const auto regressions = findRegressions(juce::JSON::parse(baselineFile), bestLatencies, threshold);
+            for (const auto& regression : regressions)
+                std::cerr << "FAIL latency: " << regression << std::endl;
+            if (!regressions.isEmpty() && exitCode == 0)
+                exitCode = 3;
+            if (regressions.isEmpty())
+                std::cout << "Latency within " << juce::String(threshold * 100.0, 0) << "% of " << baselineFile.getFileName() << std::endl;
+        }
+    }
+
+    if (outputFile != juce::File()) {
+        auto* report = new juce::DynamicObject();
+        report->setProperty("output", firstOutput);
+        report->setProperty("latency", bestLatencies);
+        report->setProperty("exitCode", exitCode);
+        outputFile.replaceWithText(juce::JSON::toString(juce::var(report)));
+    }
+
+    return exitCode;
+}